@@ -67,6 +67,14 @@ pub fn build(b: *std.Build) void {
             "main.cpp",
             "alloc.cpp",
             "arena.cpp",
+            "pool.cpp",
+            "tlsf.cpp",
+            "track.cpp",
+            "memory.cpp",
+            "upload.cpp",
+            "mesh.cpp",
+            "meshopt.cpp",
+            "codec.cpp",
             "device.cpp",
             "swapchain.cpp",
         },
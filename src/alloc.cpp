@@ -1,14 +1,20 @@
 #include "alloc.h"
 
+#include <bit>
+
 
 internal uint64_t initialize();
+internal uint64_t initializeHugePages();
 
 internal const uint64_t PAGE_SIZE = initialize();
+internal const uint64_t HUGE_PAGE_SIZE = initializeHugePages();
 
 // Runs before main
 internal uint64_t initialize() {
 #if _WIN32
-    return 0; // Page size not currently used for Windows
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
 
 #elif __linux__
     return sysconf(_SC_PAGE_SIZE);
@@ -16,11 +22,56 @@ internal uint64_t initialize() {
 #endif
 }
 
+// Runs before main
+internal uint64_t initializeHugePages() {
+#if _WIN32
+    return GetLargePageMinimum();
+
+#elif __linux__
+    FILE* meminfo = fopen("/proc/meminfo", "r");
+    if (meminfo == nullptr) {
+        return 0;
+    }
+
+    char line[128];
+    uint64_t kilobytes = 0;
+    while (fgets(line, sizeof(line), meminfo) != nullptr) {
+        if (sscanf(line, "Hugepagesize: %lu kB", &kilobytes) == 1) {
+            break;
+        }
+    }
+    fclose(meminfo);
+
+    return kilobytes * 1024;
+
+#endif
+}
+
+// Touches every page of a block so the OS backs it before first use
+internal void prefault(void* memory, uint64_t bytes, uint64_t page_size) {
+    for (uint64_t offset = 0; offset < bytes; offset += page_size) {
+        ((volatile uint8_t*)memory)[offset] = 0;
+    }
+}
+
 #if _WIN32
 VirtualMemoryBlock osAlloc(size_t minimum_bytes, uint64_t flags) {
     assert(minimum_bytes > 0);
 
-    void* memory = VirtualAlloc(nullptr, minimum_bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    void* memory = NULL;
+    uint64_t page_size = PAGE_SIZE;
+
+    // Large pages need SeLockMemoryPrivilege, without it the call fails and
+    // normal pages are used instead
+    if ((flags & OsAlloc_HugePages) && HUGE_PAGE_SIZE != 0) {
+        memory = VirtualAlloc(nullptr, alignPow2(minimum_bytes, HUGE_PAGE_SIZE),
+            MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        page_size = HUGE_PAGE_SIZE;
+    }
+    if (memory == NULL) {
+        memory = VirtualAlloc(nullptr, minimum_bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        page_size = PAGE_SIZE;
+    }
     if (memory == NULL) {
         printf("Error, failed to allocate Windows memory\n");
         exit(-1);
@@ -30,10 +81,19 @@ VirtualMemoryBlock osAlloc(size_t minimum_bytes, uint64_t flags) {
     VirtualQuery(memory, &mbi, sizeof(mbi));
     uint64_t allocated_bytes = mbi.RegionSize;
 
-    // TODO: preload pages into memory
+    if (flags & OsAlloc_WillNeed) {
+        WIN32_MEMORY_RANGE_ENTRY range = { memory, allocated_bytes };
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+    }
+    // Large pages are always resident, only normal pages need faulting in
+    if ((flags & OsAlloc_Prefault) && page_size == PAGE_SIZE) {
+        prefault(memory, allocated_bytes, page_size);
+    }
+
     return {
         .memory = memory,
-        .size = allocated_bytes
+        .size = allocated_bytes,
+        .page_size = page_size
     };
 }
 
@@ -41,20 +101,255 @@ VirtualMemoryBlock osAlloc(size_t minimum_bytes, uint64_t flags) {
 VirtualMemoryBlock osAlloc(uint64_t minimum_bytes, uint64_t flags) {
     assert(minimum_bytes > 0);
 
-    void* memory = mmap(nullptr, minimum_bytes, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, 0, 0);
+    int map_flags = MAP_ANON | MAP_PRIVATE;
+    if (flags & OsAlloc_Prefault) {
+        map_flags |= MAP_POPULATE;
+    }
+
+    void* memory = MAP_FAILED;
+    uint64_t page_size = PAGE_SIZE;
+    uint64_t allocated_bytes = 0;
+
+    if ((flags & OsAlloc_HugePages) && HUGE_PAGE_SIZE != 0) {
+        allocated_bytes = alignPow2(minimum_bytes, HUGE_PAGE_SIZE);
+        memory = mmap(nullptr, allocated_bytes, PROT_READ | PROT_WRITE, map_flags | MAP_HUGETLB, -1, 0);
+        page_size = HUGE_PAGE_SIZE;
+    }
+    // MAP_HUGETLB fails when the hugetlb pool is empty, fall back to normal
+    // pages which may still be promoted to transparent huge pages
+    if (memory == MAP_FAILED) {
+        bool transparent = (flags & (OsAlloc_HugePages | OsAlloc_TransparentHugePages)) && HUGE_PAGE_SIZE != 0;
+        // Populating before madvise would fault in normal pages, so populate
+        // afterwards by touching them
+        int normal_flags = transparent ? map_flags & ~MAP_POPULATE : map_flags;
+
+        // Round up to the nearest multiple of page size
+        allocated_bytes = alignPow2(minimum_bytes, PAGE_SIZE);
+        // Only huge page aligned ranges can be backed by huge pages, so map
+        // a huge page more and unmap what lies outside the aligned range
+        bool aligned = transparent && allocated_bytes >= HUGE_PAGE_SIZE;
+        uint64_t mapped_bytes = aligned ? allocated_bytes + HUGE_PAGE_SIZE : allocated_bytes;
+        memory = mmap(nullptr, mapped_bytes, PROT_READ | PROT_WRITE, normal_flags, -1, 0);
+        page_size = PAGE_SIZE;
+        if (memory == MAP_FAILED) {
+            printf("Error, failed to allocate Linux memory\n");
+            exit(-1);
+        }
+
+        if (aligned) {
+            uint8_t* start = (uint8_t*)alignPow2((uint64_t)memory, HUGE_PAGE_SIZE);
+            uint8_t* end = start + allocated_bytes;
+            if (start != memory) {
+                munmap(memory, start - (uint8_t*)memory);
+            }
+            munmap(end, (uint8_t*)memory + mapped_bytes - end);
+            memory = start;
+        }
+
+        if (transparent) {
+            // MADV_HUGEPAGE is only a hint, page_size is what was asked for
+            // and the kernel may still back the range with normal pages
+            if (aligned && madvise(memory, allocated_bytes, MADV_HUGEPAGE) == 0) {
+                page_size = HUGE_PAGE_SIZE;
+            }
+            if (flags & OsAlloc_Prefault) {
+                prefault(memory, allocated_bytes, PAGE_SIZE);
+            }
+        }
+    }
+
+    if (flags & OsAlloc_WillNeed) {
+        madvise(memory, allocated_bytes, MADV_WILLNEED);
+    }
+
+    return {
+        .memory = memory,
+        .size = allocated_bytes,
+        .page_size = page_size
+    };
+}
+
+#endif
+
+#if _WIN32
+VirtualMemoryBlock osReserve(uint64_t minimum_bytes) {
+    assert(minimum_bytes > 0);
+
+    void* memory = VirtualAlloc(nullptr, minimum_bytes, MEM_RESERVE, PAGE_NOACCESS);
+    if (memory == NULL) {
+        printf("Error, failed to reserve Windows memory\n");
+        exit(-1);
+    }
+
+    return {
+        .memory = memory,
+        .size = alignPow2(minimum_bytes, PAGE_SIZE),
+        .page_size = PAGE_SIZE
+    };
+}
+
+void osCommit(void* memory, uint64_t bytes, uint64_t flags) {
+    assert(memory != nullptr && bytes > 0);
+
+    if (VirtualAlloc(memory, bytes, MEM_COMMIT, PAGE_READWRITE) == NULL) {
+        printf("Error, failed to commit Windows memory\n");
+        exit(-1);
+    }
+
+    if (flags & OsAlloc_WillNeed) {
+        WIN32_MEMORY_RANGE_ENTRY range = { memory, bytes };
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+    }
+    if (flags & OsAlloc_Prefault) {
+        prefault(memory, bytes, PAGE_SIZE);
+    }
+}
+
+void osDecommit(void* memory, uint64_t bytes) {
+    assert(memory != nullptr && bytes > 0);
+
+    if (VirtualFree(memory, bytes, MEM_DECOMMIT) == 0) {
+        printf("Error, failed to decommit Windows memory\n");
+        exit(-1);
+    }
+}
+
+#elif __linux__
+VirtualMemoryBlock osReserve(uint64_t minimum_bytes) {
+    assert(minimum_bytes > 0);
+
+    // PROT_NONE and MAP_NORESERVE keep the range from counting against the
+    // commit limit until pages are committed
+    void* memory = mmap(nullptr, minimum_bytes, PROT_NONE, MAP_ANON | MAP_PRIVATE | MAP_NORESERVE, -1, 0);
     if (memory == MAP_FAILED) {
-        printf("Error, failed to allocate Linux memory\n");
+        printf("Error, failed to reserve Linux memory\n");
         exit(-1);
     }
-    // Round up to the nearest multiple of page size
-    uint64_t allocated_bytes = alignPow2(minimum_bytes, PAGE_SIZE);
 
     return {
         .memory = memory,
-        .size = allocated_bytes
+        .size = alignPow2(minimum_bytes, PAGE_SIZE),
+        .page_size = PAGE_SIZE
     };
 }
 
+void osCommit(void* memory, uint64_t bytes, uint64_t flags) {
+    assert(memory != nullptr && bytes > 0);
+
+    if (mprotect(memory, bytes, PROT_READ | PROT_WRITE) == -1) {
+        printf("Error, failed to commit Linux memory\n");
+        exit(-1);
+    }
+
+    // Reserved ranges cannot use the hugetlb pool, only transparent huge pages
+    if ((flags & (OsAlloc_HugePages | OsAlloc_TransparentHugePages)) && HUGE_PAGE_SIZE != 0) {
+        madvise(memory, bytes, MADV_HUGEPAGE);
+    }
+    if (flags & OsAlloc_WillNeed) {
+        madvise(memory, bytes, MADV_WILLNEED);
+    }
+    if (flags & OsAlloc_Prefault) {
+        prefault(memory, bytes, PAGE_SIZE);
+    }
+}
+
+void osDecommit(void* memory, uint64_t bytes) {
+    assert(memory != nullptr && bytes > 0);
+
+    // MADV_DONTNEED drops the pages, they read back as 0 if committed again
+    if (madvise(memory, bytes, MADV_DONTNEED) == -1 || mprotect(memory, bytes, PROT_NONE) == -1) {
+        printf("Error, failed to decommit Linux memory\n");
+        exit(-1);
+    }
+}
+
+#endif
+
+uint64_t osPageSize() {
+    return PAGE_SIZE;
+}
+
+uint64_t osHugePageSize() {
+    return HUGE_PAGE_SIZE;
+}
+
+#if _WIN32
+MappedFile osMapFile(const char* path, uint64_t flags) {
+    MappedFile result;
+
+    result.file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (result.file == INVALID_HANDLE_VALUE) {
+        return result;
+    }
+
+    LARGE_INTEGER size;
+    FILETIME modified;
+    if (!GetFileSizeEx(result.file, &size) || !GetFileTime(result.file, nullptr, nullptr, &modified) || size.QuadPart == 0) {
+        osUnmapFile(result);
+        return result;
+    }
+
+    result.mapping = CreateFileMappingA(result.file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    result.memory = result.mapping ? MapViewOfFile(result.mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (result.memory == nullptr) {
+        osUnmapFile(result);
+        return result;
+    }
+
+    result.size = size.QuadPart;
+    result.modified = ((uint64_t)modified.dwHighDateTime << 32) | modified.dwLowDateTime;
+
+    if (flags & OsAlloc_WillNeed) {
+        WIN32_MEMORY_RANGE_ENTRY range = { (void*)result.memory, result.size };
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+    }
+    return result;
+}
+
+void osUnmapFile(MappedFile& file) {
+    if (file.memory) UnmapViewOfFile(file.memory);
+    if (file.mapping) CloseHandle(file.mapping);
+    if (file.file != INVALID_HANDLE_VALUE) CloseHandle(file.file);
+    file = {};
+}
+
+#elif __linux__
+MappedFile osMapFile(const char* path, uint64_t flags) {
+    MappedFile result;
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return result;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) == -1 || info.st_size == 0) {
+        close(fd);
+        return result;
+    }
+
+    // the mapping keeps the file referenced after the descriptor is closed
+    void* memory = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        return result;
+    }
+
+    if (flags & OsAlloc_WillNeed) {
+        madvise(memory, info.st_size, MADV_WILLNEED);
+    }
+
+    result.memory = memory;
+    result.size = info.st_size;
+    result.modified = (uint64_t)info.st_mtim.tv_sec * 1000000000ull + info.st_mtim.tv_nsec;
+    return result;
+}
+
+void osUnmapFile(MappedFile& file) {
+    if (file.memory) munmap((void*)file.memory, file.size);
+    file = {};
+}
+
 #endif
 
 void osFree(void* ptr, uint64_t size) {
@@ -64,7 +359,8 @@ void osFree(void* ptr, uint64_t size) {
     }
 
 #if _WIN32
-    if (VirtualFree(ptr, size, MEM_RELEASE) == 0) {
+    // MEM_RELEASE frees the whole reservation and requires a size of 0
+    if (VirtualFree(ptr, 0, MEM_RELEASE) == 0) {
         printf("Error, failed to free Windows memory\n");
         exit(-1);
     }
@@ -88,9 +384,26 @@ void* alloc(Allocator& allocator, uint64_t bytes, uint64_t alignment) {
 void dealloc(Allocator& allocator, uint64_t bytes, ...) {
     assert(allocator.dealloc != nullptr && allocator.data != nullptr && bytes > 0);
 
-    allocator.dealloc(allocator, bytes);
+    va_list args;
+    va_start(args, bytes);
+    void* ptr = va_arg(args, void*);
+    va_end(args);
+
+    allocator.dealloc(allocator, bytes, ptr);
 }
 
 uint64_t alignPow2(uint64_t num, uint64_t to) {
     return num + (to - 1) & -to;
 }
+
+uint32_t bitScanReverse(uint64_t num) {
+    assert(num != 0);
+
+    return 63 - std::countl_zero(num);
+}
+
+uint32_t bitScanForward(uint64_t num) {
+    assert(num != 0);
+
+    return std::countr_zero(num);
+}
@@ -3,6 +3,7 @@
 #include "defines.h"
 
 #include <assert.h>
+#include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -11,6 +12,8 @@
     #include <windows.h>
 #elif __linux__
     #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
     #include <unistd.h>
 #else
     #error Your platform is not currently supported.
@@ -18,18 +21,63 @@
 
 struct Allocator;
 
+enum OsAllocFlags : uint64_t {
+    // Back the block with explicit huge pages (MAP_HUGETLB, MEM_LARGE_PAGES),
+    // falls back to transparent huge pages and then to normal pages
+    OsAlloc_HugePages = 1 << 0,
+    // Hint the kernel to back the block with transparent huge pages, Linux only
+    OsAlloc_TransparentHugePages = 1 << 1,
+    // Fault every page in before returning so first touches do not page fault
+    OsAlloc_Prefault = 1 << 2,
+    // Hint that the whole block will be accessed soon
+    OsAlloc_WillNeed = 1 << 3,
+};
+
 struct VirtualMemoryBlock {
     void* memory = nullptr;
     uint64_t size = 0;
+    // Size of the pages backing memory, the huge page size when huge pages
+    // were granted and the normal page size otherwise
+    uint64_t page_size = 0;
 };
 
 // Allocates contiguous block of read/writable virtual memory of at minimum
-// the bytes requested, initialized to 0
+// the bytes requested, initialized to 0, flags is a mask of OsAllocFlags
 VirtualMemoryBlock osAlloc(uint64_t minimum_bytes, uint64_t flags = 0);
+// Reserves a contiguous range of virtual address space of at minimum the bytes
+// requested without backing it, pages must be committed before being touched
+VirtualMemoryBlock osReserve(uint64_t minimum_bytes);
+// Backs a page aligned range of reserved memory with read/writable pages,
+// initialized to 0, explicit huge pages are committed as transparent ones
+void osCommit(void* memory, uint64_t bytes, uint64_t flags = 0);
+// Returns the pages of a committed range to the OS, the range stays reserved
+void osDecommit(void* memory, uint64_t bytes);
 void osFree(void* memory, uint64_t size);
+uint64_t osPageSize();
+// Returns 0 when the platform does not expose huge pages
+uint64_t osHugePageSize();
+
+// Read only view of a whole file
+struct MappedFile {
+    const void* memory = nullptr;
+    uint64_t size = 0;
+    // Last write time in platform units, only meaningful compared to itself
+    uint64_t modified = 0;
+#if _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+#endif
+};
+
+// Maps a file read only, memory stays null when the file is missing or
+// empty, OsAlloc_WillNeed starts reading it in ahead of the first touch
+MappedFile osMapFile(const char* path, uint64_t flags = 0);
+void osUnmapFile(MappedFile& file);
 
 
 typedef void*(*AllocFnPtr)(Allocator& allocator, uint64_t bytes, uint64_t alignment);
+// Allocators that free individual blocks take the block as the first variadic
+// argument, allocators that free in order such as arenas ignore it
 typedef void(*FreeFnPtr)(Allocator& allocator, uint64_t bytes, ...);
 
 struct Allocator {
@@ -39,6 +87,11 @@ struct Allocator {
 };
 // General alloc/dealloc functions, dispatches impl on allocator's function pointer
 void* alloc(Allocator& allocator, uint64_t bytes, uint64_t alignment);
+// Forwards the first variadic argument, the block being freed, to the allocator
 void dealloc(Allocator& allocator, uint64_t bytes, ...);
 // Round num up to the nearest multiple of to, to should be a multiple of 2
 uint64_t alignPow2(uint64_t num, uint64_t to);
+// Index of the most significant set bit, num must not be 0
+uint32_t bitScanReverse(uint64_t num);
+// Index of the least significant set bit, num must not be 0
+uint32_t bitScanForward(uint64_t num);
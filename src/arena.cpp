@@ -1,7 +1,8 @@
 #include "arena.h"
+#include "track.h"
 
 
-Allocator arenaNew(uint64_t minimum_bytes) {
+Allocator arenaNew(uint64_t minimum_bytes, uint64_t flags) {
     assert(minimum_bytes > 0);
 
     Arena* arena = (Arena*)calloc(1, sizeof(Arena));
@@ -10,10 +11,25 @@ Allocator arenaNew(uint64_t minimum_bytes) {
         exit(-1);
     }
 
-    VirtualMemoryBlock block = osAlloc(minimum_bytes);
-    arena->memory = block.memory;
-    arena->size = block.size;
+    if (flags & Arena_Growable) {
+        VirtualMemoryBlock block = osReserve(minimum_bytes);
+        arena->memory = block.memory;
+        arena->size = block.size;
+        arena->committed = 0;
+    } else {
+        VirtualMemoryBlock block = osAlloc(minimum_bytes, flags);
+        arena->memory = block.memory;
+        arena->size = block.size;
+        arena->committed = block.size;
+    }
     arena->last = 0;
+    arena->chunk = ARENA_COMMIT_CHUNK;
+    arena->flags = flags;
+
+    uint64_t huge_page_size = osHugePageSize();
+    if ((flags & (OsAlloc_HugePages | OsAlloc_TransparentHugePages)) && huge_page_size > arena->chunk) {
+        arena->chunk = huge_page_size;
+    }
 
     return {
         .alloc = arenaPush,
@@ -22,17 +38,35 @@ Allocator arenaNew(uint64_t minimum_bytes) {
     };
 }
 
+// Commits pages of a growable arena until at least end bytes are backed
+internal void arenaCommit(Arena* arena, uint64_t end) {
+    uint64_t target = alignPow2(end, arena->chunk);
+    if (target > arena->size) {
+        target = arena->size;
+    }
+
+    void* start = (void*)((uintptr_t)arena->memory + (uintptr_t)arena->committed);
+    osCommit(start, target - arena->committed, arena->flags);
+    arena->committed = target;
+}
+
 void* arenaPush(Allocator& allocator, uint64_t bytes, uint64_t alignment) {
     assert(allocator.data != nullptr);
 
     bytes = alignPow2(bytes, alignment);
 
     Arena* arena = (Arena*)allocator.data;
+    uint64_t start = alignPow2(arena->last, alignment);
     // Check that the arena does not overflow its own allocated memory
-    assert(((uintptr_t)arena->last + bytes) < (uintptr_t)arena->size);
+    assert((start + bytes) <= arena->size);
 
-    void* ptr = (void*)((uintptr_t)arena->memory + (uintptr_t)arena->last);
-    arena->last += bytes;
+    if (start + bytes > arena->committed) {
+        assert(arena->flags & Arena_Growable);
+        arenaCommit(arena, start + bytes);
+    }
+
+    void* ptr = (void*)((uintptr_t)arena->memory + (uintptr_t)start);
+    arena->last = start + bytes;
     return ptr;
 }
 
@@ -42,7 +76,6 @@ void arenaPop(Allocator& allocator, uint64_t bytes, ...) {
     Arena* arena = (Arena*)allocator.data;
     assert(((uintptr_t)arena->last >= bytes));
 
-    void* ptr = (void*)((uintptr_t)arena->memory + (uintptr_t)arena->last);
     arena->last -= bytes;
 }
 
@@ -51,6 +84,15 @@ void arenaReset(Allocator& allocator) {
 
     Arena* arena = (Arena*)allocator.data;
     arena->last = 0;
+
+    // Keep the first chunk resident so a reset arena that is immediately
+    // reused does not fault its pages back in
+    if ((arena->flags & Arena_Growable) && (arena->flags & Arena_DecommitOnReset) &&
+        arena->committed > arena->chunk) {
+        void* start = (void*)((uintptr_t)arena->memory + (uintptr_t)arena->chunk);
+        osDecommit(start, arena->committed - arena->chunk);
+        arena->committed = arena->chunk;
+    }
 }
 
 void arenaFree(Allocator& allocator) {
@@ -58,6 +100,289 @@ void arenaFree(Allocator& allocator) {
 
     Arena* arena = (Arena*)allocator.data;
     osFree(arena->memory, arena->size);
+    free(arena);
+
+    allocator.alloc = nullptr;
+    allocator.dealloc = nullptr;
+    allocator.data = nullptr;
+}
+
+Arena* arenaOf(Allocator& allocator) {
+    if (allocator.alloc == arenaPush) {
+        return (Arena*)allocator.data;
+    }
+    if (allocator.alloc == trackAlloc) {
+        return arenaOf(trackInner(allocator));
+    }
+    return nullptr;
+}
+
+ArenaTemp arenaTempBegin(Allocator& allocator) {
+    assert(allocator.alloc == arenaPush && allocator.data != nullptr);
+
+    Arena* arena = (Arena*)allocator.data;
+    return {
+        .allocator = &allocator,
+        .last = arena->last
+    };
+}
+
+void arenaTempEnd(ArenaTemp temp) {
+    assert(temp.allocator != nullptr && temp.allocator->alloc == arenaPush);
+
+    Arena* arena = (Arena*)temp.allocator->data;
+    assert(arena->last >= temp.last);
+    arena->last = temp.last;
+}
+
+// Scratch arenas are created on first use by a thread and released with it
+struct ScratchArenas {
+    Allocator arenas[SCRATCH_ARENA_COUNT];
+
+    ~ScratchArenas() {
+        for (Allocator& arena : arenas) {
+            if (arena.data != nullptr) {
+                arenaFree(arena);
+            }
+        }
+    }
+};
+
+internal thread_local ScratchArenas scratch_arenas;
+
+ArenaTemp scratchBegin(Allocator* const* conflicts, uint64_t count) {
+    for (Allocator& arena : scratch_arenas.arenas) {
+        bool conflicting = false;
+        for (uint64_t i = 0; i < count; i++) {
+            if (conflicts[i]->data == arena.data) {
+                conflicting = true;
+                break;
+            }
+        }
+        if (conflicting) {
+            continue;
+        }
+
+        if (arena.data == nullptr) {
+            arena = arenaNew(ARENA_DEFAULT_RESERVE, Arena_Growable);
+        }
+        return arenaTempBegin(arena);
+    }
+
+    printf("Error, every scratch arena conflicts with an arena in use\n");
+    exit(-1);
+}
+
+void scratchEnd(ArenaTemp temp) {
+    arenaTempEnd(temp);
+}
+
+FrameArenas frameArenasNew(uint32_t frame_count, uint64_t reserve_bytes) {
+    assert(frame_count > 0 && frame_count <= MAX_FRAME_ARENAS);
+
+    FrameArenas frames;
+    frames.count = frame_count;
+    for (uint32_t i = 0; i < frame_count; i++) {
+        // Pages stay committed across resets so steady state frames never
+        // fault or make a syscall
+        frames.arenas[i] = arenaNew(reserve_bytes, Arena_Growable);
+    }
+    return frames;
+}
+
+Allocator& frameArenaBegin(FrameArenas& frames, uint32_t frame) {
+    assert(frame < frames.count);
+
+    arenaReset(frames.arenas[frame]);
+    return frames.arenas[frame];
+}
+
+void frameArenasFree(FrameArenas& frames) {
+    for (uint32_t i = 0; i < frames.count; i++) {
+        arenaFree(frames.arenas[i]);
+    }
+    frames.count = 0;
+}
+
+// Chunk of a SharedArena claimed by the calling thread
+struct SharedArenaCache {
+    SharedArena* arena = nullptr;
+    uint64_t epoch = 0;
+    uint64_t cursor = 0;
+    uint64_t end = 0;
+};
+
+internal std::atomic<uint64_t> shared_arena_epoch = 1;
+internal thread_local SharedArenaCache shared_arena_caches[SHARED_ARENA_THREAD_CACHES];
+internal thread_local uint32_t shared_arena_next_cache = 0;
+
+Allocator sharedArenaNew(uint64_t minimum_bytes, uint64_t flags) {
+    assert(minimum_bytes > 0);
+
+    SharedArena* arena = new SharedArena();
+    if (flags & Arena_Growable) {
+        VirtualMemoryBlock block = osReserve(minimum_bytes);
+        arena->memory = block.memory;
+        arena->size = block.size;
+        arena->committed = 0;
+    } else {
+        VirtualMemoryBlock block = osAlloc(minimum_bytes, flags);
+        arena->memory = block.memory;
+        arena->size = block.size;
+        arena->committed = block.size;
+    }
+    arena->chunk = ARENA_COMMIT_CHUNK;
+    arena->flags = flags;
+    arena->epoch = shared_arena_epoch.fetch_add(1);
+
+    uint64_t huge_page_size = osHugePageSize();
+    if ((flags & (OsAlloc_HugePages | OsAlloc_TransparentHugePages)) && huge_page_size > arena->chunk) {
+        arena->chunk = huge_page_size;
+    }
+
+    return {
+        .alloc = sharedArenaPush,
+        .dealloc = sharedArenaPop,
+        .data = arena
+    };
+}
+
+// Commits the pages of a growable arena up to end, if another thread is
+// already committing waits for it
+internal void sharedArenaCommit(SharedArena* arena, uint64_t end) {
+    while (end > arena->committed.load(std::memory_order_acquire)) {
+        assert(arena->flags & Arena_Growable);
+
+        if (arena->committing.exchange(true, std::memory_order_acquire)) {
+            continue;
+        }
+
+        // Another thread may have committed past end while this one waited
+        uint64_t committed = arena->committed.load(std::memory_order_relaxed);
+        if (end > committed) {
+            uint64_t target = alignPow2(end, arena->chunk);
+            if (target > arena->size) {
+                target = arena->size;
+            }
+            osCommit((uint8_t*)arena->memory + committed, target - committed, arena->flags);
+            arena->committed.store(target, std::memory_order_release);
+        }
+        arena->committing.store(false, std::memory_order_release);
+    }
+}
+
+// Claims exactly bytes past last for the calling thread, returns the offset of
+// the claimed range
+internal uint64_t sharedArenaClaim(SharedArena* arena, uint64_t bytes) {
+    uint64_t start = arena->last.fetch_add(bytes, std::memory_order_relaxed);
+    uint64_t end = start + bytes;
+    if (end > arena->size) {
+        printf("Error, shared arena of %llu bytes overflowed\n", (unsigned long long)arena->size);
+        exit(-1);
+    }
+
+    sharedArenaCommit(arena, end);
+    return start;
+}
+
+// Claims a chunk of up to SHARED_ARENA_CHUNK bytes, less near the end of the
+// arena. False when fewer than minimum bytes are left to claim
+internal bool sharedArenaClaimChunk(SharedArena* arena, uint64_t minimum, uint64_t* start, uint64_t* bytes) {
+    uint64_t last = arena->last.load(std::memory_order_relaxed);
+    uint64_t size = 0;
+    do {
+        if (last >= arena->size || arena->size - last < minimum) {
+            return false;
+        }
+        size = arena->size - last;
+        if (size > SHARED_ARENA_CHUNK) {
+            size = SHARED_ARENA_CHUNK;
+        }
+    } while (!arena->last.compare_exchange_weak(last, last + size, std::memory_order_relaxed));
+
+    sharedArenaCommit(arena, last + size);
+    *start = last;
+    *bytes = size;
+    return true;
+}
+
+void* sharedArenaPush(Allocator& allocator, uint64_t bytes, uint64_t alignment) {
+    assert(allocator.data != nullptr && bytes > 0);
+
+    SharedArena* arena = (SharedArena*)allocator.data;
+
+    SharedArenaCache* cache = nullptr;
+    for (SharedArenaCache& entry : shared_arena_caches) {
+        if (entry.arena == arena && entry.epoch == arena->epoch) {
+            cache = &entry;
+            break;
+        }
+    }
+
+    // Fast path, bump through this thread's chunk without atomics
+    if (cache != nullptr) {
+        uint64_t start = alignPow2(cache->cursor, alignment);
+        if (start + bytes <= cache->end) {
+            cache->cursor = start + bytes;
+            return (uint8_t*)arena->memory + start;
+        }
+    }
+
+    // Pushes that would waste most of a chunk claim exactly what they need
+    if (bytes + alignment > SHARED_ARENA_CHUNK / 2) {
+        uint64_t start = sharedArenaClaim(arena, bytes + alignment - 1);
+        return (uint8_t*)arena->memory + alignPow2(start, alignment);
+    }
+
+    if (cache == nullptr) {
+        cache = &shared_arena_caches[shared_arena_next_cache];
+        shared_arena_next_cache = (shared_arena_next_cache + 1) % SHARED_ARENA_THREAD_CACHES;
+    }
+
+    // Near the end of the arena the push takes what fits, only the exact claim
+    // reports an overflow
+    uint64_t chunk_start = 0;
+    uint64_t chunk_bytes = 0;
+    if (!sharedArenaClaimChunk(arena, bytes + alignment, &chunk_start, &chunk_bytes)) {
+        uint64_t start = sharedArenaClaim(arena, bytes + alignment - 1);
+        return (uint8_t*)arena->memory + alignPow2(start, alignment);
+    }
+    cache->arena = arena;
+    cache->epoch = arena->epoch;
+    cache->end = chunk_start + chunk_bytes;
+
+    uint64_t start = alignPow2(chunk_start, alignment);
+    cache->cursor = start + bytes;
+    return (uint8_t*)arena->memory + start;
+}
+
+void sharedArenaPop(Allocator& allocator, uint64_t bytes, ...) {
+    assert(allocator.data != nullptr);
+}
+
+void sharedArenaReset(Allocator& allocator) {
+    assert(allocator.alloc == sharedArenaPush && allocator.data != nullptr);
+
+    SharedArena* arena = (SharedArena*)allocator.data;
+    arena->last.store(0, std::memory_order_relaxed);
+    arena->epoch = shared_arena_epoch.fetch_add(1);
+
+    // Same as arenaReset, the first chunk stays resident
+    uint64_t committed = arena->committed.load(std::memory_order_relaxed);
+    if ((arena->flags & Arena_Growable) && (arena->flags & Arena_DecommitOnReset) &&
+        committed > arena->chunk) {
+        void* start = (void*)((uintptr_t)arena->memory + (uintptr_t)arena->chunk);
+        osDecommit(start, committed - arena->chunk);
+        arena->committed.store(arena->chunk, std::memory_order_relaxed);
+    }
+}
+
+void sharedArenaFree(Allocator& allocator) {
+    assert(allocator.alloc == sharedArenaPush && allocator.data != nullptr);
+
+    SharedArena* arena = (SharedArena*)allocator.data;
+    osFree(arena->memory, arena->size);
+    delete arena;
 
     allocator.alloc = nullptr;
     allocator.dealloc = nullptr;
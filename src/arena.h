@@ -3,17 +3,41 @@
 #include "alloc.h"
 
 #include <stdint.h>
+#include <atomic>
+#include <initializer_list>
 
 
+// Address space reserved by growable arenas when no size is given
+#define ARENA_DEFAULT_RESERVE (64ull << 30)
+// Granularity growable arenas commit pages at as last grows
+#define ARENA_COMMIT_CHUNK (64ull << 10)
+
+// Arena flags may be combined with OsAllocFlags, which are forwarded to the OS
+// when the arena maps or commits its pages
+enum ArenaFlags : uint64_t {
+    // Reserve minimum_bytes of address space and commit pages as last grows
+    // instead of mapping the whole arena up front
+    Arena_Growable = 1 << 8,
+    // Return committed pages past the first chunk to the OS on arenaReset,
+    // only meaningful for growable arenas
+    Arena_DecommitOnReset = 1 << 9,
+};
+
 // Allocates memory using an increasing offset to its own reserved memory,
 // returns blocks of memory from the top of the arena
 struct Arena {
     void* memory = nullptr;
     uint64_t size = 0;
     uint64_t last = 0;
+    // Bytes from memory backed by pages, equal to size for non growable arenas
+    uint64_t committed = 0;
+    // Granularity pages are committed at, raised to the huge page size when
+    // huge pages are requested so each commit can be backed by one
+    uint64_t chunk = 0;
+    uint64_t flags = 0;
 };
 
-Allocator arenaNew(uint64_t minimum_bytes);
+Allocator arenaNew(uint64_t minimum_bytes, uint64_t flags = 0);
 // Impl of alloc for Arenas, equivalent to alloc(arena_allocator, ...)
 void* arenaPush(Allocator& allocator, uint64_t bytes, uint64_t alignment);
 #define arenaPushN(allocator, type, count) \
@@ -25,3 +49,87 @@ void arenaPop(Allocator& allocator, uint64_t bytes, ...);
 // previously allocated memory
 void arenaReset(Allocator& allocator);
 void arenaFree(Allocator& allocator);
+// Returns the arena behind an arena allocator, looking through tracking
+// wrappers, or null for any other allocator
+Arena* arenaOf(Allocator& allocator);
+
+// Checkpoint of an arena's last offset, ending it invalidates everything
+// allocated from the arena since it began
+struct ArenaTemp {
+    Allocator* allocator = nullptr;
+    uint64_t last = 0;
+};
+
+ArenaTemp arenaTempBegin(Allocator& allocator);
+void arenaTempEnd(ArenaTemp temp);
+
+// Number of scratch arenas per thread, a function that takes an arena argument
+// can always find a scratch arena that is not the one it was given
+#define SCRATCH_ARENA_COUNT 2
+
+// Begins a checkpoint on one of the calling thread's scratch arenas that is not
+// any of the conflicting allocators, conflicts may be null when count is 0
+ArenaTemp scratchBegin(Allocator* const* conflicts = nullptr, uint64_t count = 0);
+void scratchEnd(ArenaTemp temp);
+
+// Scratch checkpoint that is ended when it leaves scope
+struct Scratch {
+    ArenaTemp temp;
+
+    Scratch(): temp(scratchBegin()) {}
+    Scratch(std::initializer_list<Allocator*> conflicts):
+        temp(scratchBegin(conflicts.begin(), conflicts.size())) {}
+    ~Scratch() { scratchEnd(temp); }
+    Scratch(const Scratch&) = delete;
+    Scratch& operator=(const Scratch&) = delete;
+
+    Allocator& allocator() { return *temp.allocator; }
+};
+
+// Upper bound on the frames in flight a FrameArenas can cover
+#define MAX_FRAME_ARENAS 4
+
+// One arena per frame in flight, a frame's arena is reset when the frame
+// begins again, which must be after the GPU finished with its previous use
+struct FrameArenas {
+    Allocator arenas[MAX_FRAME_ARENAS];
+    uint32_t count = 0;
+};
+
+FrameArenas frameArenasNew(uint32_t frame_count, uint64_t reserve_bytes = ARENA_DEFAULT_RESERVE);
+// Resets and returns the arena of frame, call once the frame's fence signalled
+Allocator& frameArenaBegin(FrameArenas& frames, uint32_t frame);
+void frameArenasFree(FrameArenas& frames);
+
+// Bytes a thread claims from a SharedArena at once and then bumps through
+// without touching shared state
+#define SHARED_ARENA_CHUNK (64ull << 10)
+// Number of SharedArenas a thread keeps a claimed chunk of at the same time
+#define SHARED_ARENA_THREAD_CACHES 4
+
+// Arena that many threads push to at once. Threads bump through chunks they
+// claimed with an atomic fetch-add and only contend when a chunk runs out,
+// large pushes claim exactly their size. Individual pops are not supported
+struct SharedArena {
+    void* memory = nullptr;
+    uint64_t size = 0;
+    std::atomic<uint64_t> last = 0;
+    std::atomic<uint64_t> committed = 0;
+    // Held by the one thread committing more pages of a growable arena
+    std::atomic<bool> committing = false;
+    uint64_t chunk = 0;
+    uint64_t flags = 0;
+    // Unique per arena and per reset, thread chunks from older epochs are stale
+    uint64_t epoch = 0;
+};
+
+// Accepts the same flags as arenaNew
+Allocator sharedArenaNew(uint64_t minimum_bytes, uint64_t flags = 0);
+// Impl of alloc for SharedArenas, safe to call from any number of threads
+void* sharedArenaPush(Allocator& allocator, uint64_t bytes, uint64_t alignment);
+// Impl of dealloc for SharedArenas, does nothing as memory is only released by
+// sharedArenaReset
+void sharedArenaPop(Allocator& allocator, uint64_t bytes, ...);
+// Invalidates all memory pushed so far, must not run concurrently with pushes
+void sharedArenaReset(Allocator& allocator);
+void sharedArenaFree(Allocator& allocator);
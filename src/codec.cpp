@@ -0,0 +1,406 @@
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CODEC_SSE2 1
+#else
+#define CODEC_SSE2 0
+#endif
+
+#include <glm/common.hpp>
+
+#include "codec.h"
+
+// Entries of the index codec's FIFOs, a code addresses 15 edges and 14 vertices
+#define CODEC_EDGE_FIFO 16
+#define CODEC_VERTEX_FIFO 16
+
+static uint32_t zigzag(uint32_t v){
+    return (v << 1) ^ (uint32_t)((int32_t)v >> 31);
+}
+
+static uint32_t unzigzag(uint32_t v){
+    return (v >> 1) ^ (0u - (v & 1));
+}
+
+// Bytes one byte plane of count bytes can take, a 2 bit width per 16 bytes
+// and the groups at full width
+static size_t getBytePlaneBound(size_t count){
+    size_t groups = count / 16;
+    return (groups + 3) / 4 + groups * 16;
+}
+
+size_t encodeVertexBufferBound(size_t vertexCount, size_t vertexSize){
+    size_t blocks = (vertexCount + CODEC_BLOCK_VERTICES - 1) / CODEC_BLOCK_VERTICES;
+    return blocks * vertexSize * getBytePlaneBound(CODEC_BLOCK_VERTICES);
+}
+
+// Widths are 0, 2, 4 or 8 bits, the smallest that holds every byte of the group
+static uint8_t* encodeBytePlane(uint8_t* out, const uint8_t* bytes, size_t count){
+    size_t groups = count / 16;
+    uint8_t* header = out;
+    memset(header, 0, (groups + 3) / 4);
+    out += (groups + 3) / 4;
+
+    for(size_t g=0;g<groups;g++){
+        const uint8_t* group = bytes + g * 16;
+        uint8_t bits = 0;
+        for(int i=0;i<16;i++)
+            bits |= group[i];
+
+        uint32_t width = bits == 0 ? 0 : bits < 4 ? 1 : bits < 16 ? 2 : 3;
+        header[g / 4] |= (uint8_t)(width << (g % 4 * 2));
+
+        if(width == 1){
+            for(int i=0;i<4;i++)
+                out[i] = group[i * 4] | group[i * 4 + 1] << 2 | group[i * 4 + 2] << 4 | group[i * 4 + 3] << 6;
+            out += 4;
+        }else if(width == 2){
+            for(int i=0;i<8;i++)
+                out[i] = group[i * 2] | group[i * 2 + 1] << 4;
+            out += 8;
+        }else if(width == 3){
+            memcpy(out, group, 16);
+            out += 16;
+        }
+    }
+    return out;
+}
+
+// Returns the end of the plane or null when it runs past end
+static const uint8_t* decodeBytePlane(const uint8_t* data, const uint8_t* end, uint8_t* bytes, size_t count){
+    size_t groups = count / 16;
+    const uint8_t* header = data;
+    if((size_t)(end - data) < (groups + 3) / 4) return nullptr;
+    data += (groups + 3) / 4;
+
+    for(size_t g=0;g<groups;g++){
+        uint8_t* group = bytes + g * 16;
+        uint32_t width = header[g / 4] >> (g % 4 * 2) & 3;
+        size_t size = width == 0 ? 0 : (size_t)2 << width;
+        if((size_t)(end - data) < size) return nullptr;
+
+#if CODEC_SSE2
+        __m128i result;
+        if(width == 0){
+            result = _mm_setzero_si128();
+        }else if(width == 1){
+            // 4 bytes of 4 values each, split by shift and interleaved back in order
+            int packed;
+            memcpy(&packed, data, 4);
+            __m128i x = _mm_cvtsi32_si128(packed);
+            __m128i mask = _mm_set1_epi8(3);
+            __m128i v0 = _mm_and_si128(x, mask);
+            __m128i v1 = _mm_and_si128(_mm_srli_epi16(x, 2), mask);
+            __m128i v2 = _mm_and_si128(_mm_srli_epi16(x, 4), mask);
+            __m128i v3 = _mm_and_si128(_mm_srli_epi16(x, 6), mask);
+            result = _mm_unpacklo_epi16(_mm_unpacklo_epi8(v0, v1), _mm_unpacklo_epi8(v2, v3));
+        }else if(width == 2){
+            __m128i x = _mm_loadl_epi64((const __m128i*)data);
+            __m128i mask = _mm_set1_epi8(15);
+            result = _mm_unpacklo_epi8(_mm_and_si128(x, mask), _mm_and_si128(_mm_srli_epi16(x, 4), mask));
+        }else{
+            result = _mm_loadu_si128((const __m128i*)data);
+        }
+        _mm_storeu_si128((__m128i*)group, result);
+#else
+        if(width == 0){
+            memset(group, 0, 16);
+        }else if(width == 1){
+            for(int i=0;i<16;i++)
+                group[i] = data[i / 4] >> (i % 4 * 2) & 3;
+        }else if(width == 2){
+            for(int i=0;i<16;i++)
+                group[i] = data[i / 2] >> (i % 2 * 4) & 15;
+        }else{
+            memcpy(group, data, 16);
+        }
+#endif
+        data += size;
+    }
+    return data;
+}
+
+size_t encodeVertexBuffer(uint8_t* buffer, size_t bufferSize, const void* vertices, size_t vertexCount,
+    size_t vertexSize){
+    assert(vertexSize % 4 == 0 && vertexSize > 0 && vertexSize <= CODEC_MAX_VERTEX_SIZE);
+    if(bufferSize < encodeVertexBufferBound(vertexCount, vertexSize)) return 0;
+
+    const uint8_t* source = (const uint8_t*)vertices;
+    size_t wordCount = vertexSize / 4;
+    uint32_t previous[CODEC_MAX_VERTEX_SIZE / 4] = {};
+    uint32_t deltas[CODEC_BLOCK_VERTICES];
+    uint8_t plane[CODEC_BLOCK_VERTICES];
+
+    uint8_t* out = buffer;
+    for(size_t first=0;first<vertexCount;first+=CODEC_BLOCK_VERTICES){
+        size_t count = glm::min(vertexCount - first, (size_t)CODEC_BLOCK_VERTICES);
+        // the last block is padded with zero deltas to whole groups
+        size_t padded = alignPow2(count, 16);
+
+        for(size_t w=0;w<wordCount;w++){
+            for(size_t i=0;i<count;i++){
+                uint32_t word;
+                memcpy(&word, source + (first + i) * vertexSize + w * 4, 4);
+                deltas[i] = zigzag(word - previous[w]);
+                previous[w] = word;
+            }
+            for(size_t i=count;i<padded;i++)
+                deltas[i] = 0;
+
+            for(uint32_t k=0;k<4;k++){
+                for(size_t i=0;i<padded;i++)
+                    plane[i] = (uint8_t)(deltas[i] >> (k * 8));
+                out = encodeBytePlane(out, plane, padded);
+            }
+        }
+    }
+    return out - buffer;
+}
+
+bool decodeVertexBuffer(void* destination, size_t vertexCount, size_t vertexSize, const uint8_t* buffer,
+    size_t bufferSize){
+    assert(vertexSize % 4 == 0 && vertexSize > 0 && vertexSize <= CODEC_MAX_VERTEX_SIZE);
+
+    uint8_t* target = (uint8_t*)destination;
+    const uint8_t* data = buffer;
+    const uint8_t* end = buffer + bufferSize;
+    size_t wordCount = vertexSize / 4;
+    uint32_t previous[CODEC_MAX_VERTEX_SIZE / 4] = {};
+    alignas(16) uint8_t planes[4][CODEC_BLOCK_VERTICES];
+
+    for(size_t first=0;first<vertexCount;first+=CODEC_BLOCK_VERTICES){
+        size_t count = glm::min(vertexCount - first, (size_t)CODEC_BLOCK_VERTICES);
+        size_t padded = alignPow2(count, 16);
+
+        // a word at a time, its 4 planes are next to each other in the stream
+        for(size_t w=0;w<wordCount;w++){
+            for(uint32_t k=0;k<4 && data;k++)
+                data = decodeBytePlane(data, end, planes[k], padded);
+            if(!data) return false;
+
+            uint8_t* out = target + first * vertexSize + w * 4;
+            uint32_t last = previous[w];
+            size_t i = 0;
+#if CODEC_SSE2
+            __m128i one = _mm_set1_epi32(1);
+            __m128i sum = _mm_set1_epi32((int)last);
+            for(;i + 16<=count;i+=16){
+                __m128i p0 = _mm_load_si128((const __m128i*)(planes[0] + i));
+                __m128i p1 = _mm_load_si128((const __m128i*)(planes[1] + i));
+                __m128i p2 = _mm_load_si128((const __m128i*)(planes[2] + i));
+                __m128i p3 = _mm_load_si128((const __m128i*)(planes[3] + i));
+
+                // bytes back into words, 4 vertices per register
+                __m128i low0 = _mm_unpacklo_epi8(p0, p1), low1 = _mm_unpackhi_epi8(p0, p1);
+                __m128i high0 = _mm_unpacklo_epi8(p2, p3), high1 = _mm_unpackhi_epi8(p2, p3);
+                __m128i words[4] = {
+                    _mm_unpacklo_epi16(low0, high0), _mm_unpackhi_epi16(low0, high0),
+                    _mm_unpacklo_epi16(low1, high1), _mm_unpackhi_epi16(low1, high1),
+                };
+
+                for(int j=0;j<4;j++){
+                    __m128i delta = _mm_xor_si128(_mm_srli_epi32(words[j], 1),
+                        _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(words[j], one)));
+
+                    // running sum across the 4 lanes, then on top of the vertex before
+                    delta = _mm_add_epi32(delta, _mm_slli_si128(delta, 4));
+                    delta = _mm_add_epi32(delta, _mm_slli_si128(delta, 8));
+                    sum = _mm_add_epi32(sum, delta);
+
+                    uint8_t* vertex = out + (i + j * 4) * vertexSize;
+                    uint32_t v0 = (uint32_t)_mm_cvtsi128_si32(sum);
+                    uint32_t v1 = (uint32_t)_mm_cvtsi128_si32(_mm_shuffle_epi32(sum, 0x55));
+                    uint32_t v2 = (uint32_t)_mm_cvtsi128_si32(_mm_shuffle_epi32(sum, 0xaa));
+                    sum = _mm_shuffle_epi32(sum, 0xff);
+                    uint32_t v3 = (uint32_t)_mm_cvtsi128_si32(sum);
+                    memcpy(vertex, &v0, 4);
+                    memcpy(vertex + vertexSize, &v1, 4);
+                    memcpy(vertex + vertexSize * 2, &v2, 4);
+                    memcpy(vertex + vertexSize * 3, &v3, 4);
+                }
+            }
+            last = (uint32_t)_mm_cvtsi128_si32(sum);
+#endif
+            for(;i<count;i++){
+                uint32_t word = planes[0][i] | planes[1][i] << 8 | planes[2][i] << 16 | (uint32_t)planes[3][i] << 24;
+                last += unzigzag(word);
+                memcpy(out + i * vertexSize, &last, 4);
+            }
+            previous[w] = last;
+        }
+    }
+    return data == end;
+}
+
+// FIFOs both sides of the index codec update the same way, entry 0 is the newest
+struct IndexFifo{
+    uint32_t edges[CODEC_EDGE_FIFO][2];
+    uint32_t vertices[CODEC_VERTEX_FIFO];
+    uint32_t edgeOffset;
+    uint32_t vertexOffset;
+    // the vertex a new vertex code stands for
+    uint32_t next;
+    // explicit vertices are coded relative to the one before
+    uint32_t last;
+};
+
+static void pushEdge(IndexFifo& fifo, uint32_t a, uint32_t b){
+    fifo.edges[fifo.edgeOffset % CODEC_EDGE_FIFO][0] = a;
+    fifo.edges[fifo.edgeOffset % CODEC_EDGE_FIFO][1] = b;
+    fifo.edgeOffset++;
+}
+
+static void pushVertex(IndexFifo& fifo, uint32_t v){
+    fifo.vertices[fifo.vertexOffset % CODEC_VERTEX_FIFO] = v;
+    fifo.vertexOffset++;
+}
+
+// The neighbours of a triangle see its edges reversed
+static void pushTriangle(IndexFifo& fifo, uint32_t a, uint32_t b, uint32_t c){
+    pushEdge(fifo, b, a);
+    pushEdge(fifo, c, b);
+    pushEdge(fifo, a, c);
+}
+
+static int findEdge(const IndexFifo& fifo, uint32_t a, uint32_t b){
+    for(uint32_t i=0;i<CODEC_EDGE_FIFO - 1;i++){
+        const uint32_t* edge = fifo.edges[(fifo.edgeOffset - 1 - i) % CODEC_EDGE_FIFO];
+        if(edge[0] == a && edge[1] == b) return (int)i;
+    }
+    return -1;
+}
+
+// Vertex codes: 0 is the next new vertex, 1 to 14 recent vertices and 15 an
+// explicit varint that follows the triangle's code bytes
+static uint32_t encodeVertex(IndexFifo& fifo, uint32_t v, uint8_t*& out){
+    if(v == fifo.next){
+        fifo.next++;
+        pushVertex(fifo, v);
+        return 0;
+    }
+
+    for(uint32_t i=0;i<CODEC_VERTEX_FIFO - 2;i++)
+        if(fifo.vertices[(fifo.vertexOffset - 1 - i) % CODEC_VERTEX_FIFO] == v)
+            return i + 1;
+
+    uint32_t value = zigzag(v - fifo.last);
+    while(value >= 0x80){
+        *out++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (uint8_t)value;
+
+    fifo.last = v;
+    pushVertex(fifo, v);
+    return 15;
+}
+
+// data becomes null when a varint runs past end
+static uint32_t decodeVertex(IndexFifo& fifo, uint32_t code, const uint8_t*& data, const uint8_t* end){
+    if(code == 0){
+        uint32_t v = fifo.next++;
+        pushVertex(fifo, v);
+        return v;
+    }
+    if(code < 15)
+        return fifo.vertices[(fifo.vertexOffset - code) % CODEC_VERTEX_FIFO];
+
+    uint32_t value = 0;
+    for(uint32_t shift=0;;shift+=7){
+        if(data == end || shift > 28){
+            data = nullptr;
+            return 0;
+        }
+        uint8_t byte = *data++;
+        value |= (uint32_t)(byte & 0x7f) << shift;
+        if(byte < 0x80) break;
+    }
+
+    uint32_t v = fifo.last + unzigzag(value);
+    fifo.last = v;
+    pushVertex(fifo, v);
+    return v;
+}
+
+size_t encodeIndexBufferBound(size_t indexCount){
+    size_t triangleCount = indexCount / 3;
+    // 2 code bytes and 3 varints of up to 5 bytes for a triangle without edge
+    return (triangleCount + 3) / 4 + triangleCount * 17;
+}
+
+size_t encodeIndexBuffer(uint8_t* buffer, size_t bufferSize, const uint32_t* indices, size_t indexCount){
+    assert(indexCount % 3 == 0);
+    if(bufferSize < encodeIndexBufferBound(indexCount)) return 0;
+
+    // 2 bits per triangle for which of its corners the matched edge starts at,
+    // so the triangles come back with their corners in the same order
+    size_t triangleCount = indexCount / 3;
+    uint8_t* rotations = buffer;
+    memset(rotations, 0, (triangleCount + 3) / 4);
+    uint8_t* out = buffer + (triangleCount + 3) / 4;
+
+    IndexFifo fifo{};
+    for(size_t t=0;t<triangleCount;t++){
+        const uint32_t* triangle = indices + t * 3;
+
+        int edge = -1;
+        uint32_t rotation = 0;
+        for(;rotation<3;rotation++){
+            edge = findEdge(fifo, triangle[rotation], triangle[(rotation + 1) % 3]);
+            if(edge >= 0) break;
+        }
+
+        if(edge >= 0){
+            uint8_t* code = out++;
+            *code = (uint8_t)(edge << 4 | encodeVertex(fifo, triangle[(rotation + 2) % 3], out));
+            rotations[t / 4] |= (uint8_t)(rotation << (t % 4 * 2));
+        }else{
+            uint8_t* code = out;
+            out += 2;
+            uint32_t a = encodeVertex(fifo, triangle[0], out);
+            uint32_t b = encodeVertex(fifo, triangle[1], out);
+            uint32_t c = encodeVertex(fifo, triangle[2], out);
+            code[0] = (uint8_t)(0xf0 | a);
+            code[1] = (uint8_t)(b << 4 | c);
+        }
+
+        pushTriangle(fifo, triangle[0], triangle[1], triangle[2]);
+    }
+    return out - buffer;
+}
+
+bool decodeIndexBuffer(uint32_t* destination, size_t indexCount, const uint8_t* buffer, size_t bufferSize){
+    assert(indexCount % 3 == 0);
+
+    size_t triangleCount = indexCount / 3;
+    if(bufferSize < (triangleCount + 3) / 4) return false;
+    const uint8_t* rotations = buffer;
+    const uint8_t* data = buffer + (triangleCount + 3) / 4;
+    const uint8_t* end = buffer + bufferSize;
+
+    IndexFifo fifo{};
+    for(size_t t=0;t<triangleCount;t++){
+        if(data == end) return false;
+        uint32_t code = *data++;
+        uint32_t* triangle = destination + t * 3;
+
+        if(code < 0xf0){
+            const uint32_t* edge = fifo.edges[(fifo.edgeOffset - 1 - (code >> 4)) % CODEC_EDGE_FIFO];
+            uint32_t rotation = rotations[t / 4] >> (t % 4 * 2) & 3;
+            if(rotation > 2) return false;
+
+            triangle[rotation] = edge[0];
+            triangle[(rotation + 1) % 3] = edge[1];
+            triangle[(rotation + 2) % 3] = decodeVertex(fifo, code & 15, data, end);
+        }else{
+            if(data == end) return false;
+            uint32_t codes = *data++;
+            triangle[0] = decodeVertex(fifo, code & 15, data, end);
+            if(data) triangle[1] = decodeVertex(fifo, codes >> 4, data, end);
+            if(data) triangle[2] = decodeVertex(fifo, codes & 15, data, end);
+        }
+        if(!data) return false;
+
+        pushTriangle(fifo, triangle[0], triangle[1], triangle[2]);
+    }
+    return data == end;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "common.h"
+
+// Lossless codecs for geometry at rest. Decoding runs at about 1-2 GB/s of
+// output per core for vertices and 1 GB/s for indices, so reading the smaller
+// stream and decoding it only beats reading the raw one from storage slower
+// than about 1 GB/s, not from fast NVMe drives or the page cache
+
+// Vertices per block of the vertex codec, a multiple of 16
+#define CODEC_BLOCK_VERTICES 256
+// Largest vertex the vertex codec takes, vertex sizes are multiples of 4
+#define CODEC_MAX_VERTEX_SIZE 256
+
+// Vertices are coded as 32 bit words. Each word is stored as the zigzagged
+// difference to the same word of the vertex before, whose bytes are split
+// into planes per block. Every 16 bytes of a plane are bit packed to 0, 2, 4
+// or 8 bits, floats of neighbouring vertices mostly differ in the low bytes
+size_t encodeVertexBufferBound(size_t vertexCount, size_t vertexSize);
+
+// Returns the encoded size, 0 when buffer is smaller than the bound
+size_t encodeVertexBuffer(uint8_t* buffer, size_t bufferSize, const void* vertices, size_t vertexCount,
+    size_t vertexSize);
+
+// False when the data is malformed or does not hold vertexCount vertices
+bool decodeVertexBuffer(void* destination, size_t vertexCount, size_t vertexSize, const uint8_t* buffer,
+    size_t bufferSize);
+
+// Triangles are coded against a FIFO of recently seen edges and one of
+// recently seen vertices, a triangle sharing an edge with a recent one costs
+// a byte when its third vertex is new or recent. Vertices first used in
+// order, which optimizeVertexFetch guarantees, need no explicit index
+size_t encodeIndexBufferBound(size_t indexCount);
+
+// Returns the encoded size, 0 when buffer is smaller than the bound.
+// indexCount is a multiple of 3
+size_t encodeIndexBuffer(uint8_t* buffer, size_t bufferSize, const uint32_t* indices, size_t indexCount);
+
+// False when the data is malformed or does not hold indexCount indices
+bool decodeIndexBuffer(uint32_t* destination, size_t indexCount, const uint8_t* buffer, size_t bufferSize);
@@ -15,11 +15,14 @@
 #include <fstream>
 #include <iostream>
 #include <array>
-#include <unordered_map>
+#include <thread>
 
 #include "types.h"
 #include "alloc.h"
 #include "arena.h"
+#include "pool.h"
+#include "tlsf.h"
+#include "track.h"
 
 #define MIN_IMAGE_COUNT 3
 
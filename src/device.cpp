@@ -61,6 +61,36 @@ uint32_t getGraphicsFamilyIndex(VkPhysicalDevice physicalDevice){
     return VK_QUEUE_FAMILY_IGNORED;
 }
 
+QueueFamilies getQueueFamilies(VkPhysicalDevice physicalDevice){
+    uint32_t queueCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueCount, 0);
+
+    std::vector<VkQueueFamilyProperties> queues(queueCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueCount, queues.data());
+
+    QueueFamilies result{};
+    result.graphics = getGraphicsFamilyIndex(physicalDevice);
+    result.transfer = result.graphics;
+    result.compute = result.graphics;
+
+    for(uint32_t i=0; i<queueCount;i++){
+        VkQueueFlags flags = queues[i].queueFlags;
+        if(flags & VK_QUEUE_GRAPHICS_BIT) continue;
+
+        if(result.transfer == result.graphics && (flags & VK_QUEUE_TRANSFER_BIT) && !(flags & VK_QUEUE_COMPUTE_BIT))
+            result.transfer = i;
+
+        if(result.compute == result.graphics && (flags & VK_QUEUE_COMPUTE_BIT))
+            result.compute = i;
+    }
+
+    // compute queues can copy too, still better than sharing with rendering
+    if(result.transfer == result.graphics)
+        result.transfer = result.compute;
+
+    return result;
+}
+
 bool supportsPresentation(VkPhysicalDevice physicalDevice, uint32_t index, VkSurfaceKHR surface){
     VkBool32 presentSupport = false;
     vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice,index,surface,&presentSupport);
@@ -109,20 +139,36 @@ VkPhysicalDevice selectPhysicalDevice(VkPhysicalDevice* physicalDevices, uint32_
     return result;
 }
 
-VkDevice createDevice(VkInstance instance, VkPhysicalDevice physicalDevice, uint32_t index,
-    bool raytracingSupported, bool unifiedlayoutSupported){
+VkDevice createDevice(VkInstance instance, VkPhysicalDevice physicalDevice, const QueueFamilies& families,
+    bool raytracingSupported, bool unifiedlayoutSupported, bool memoryBudgetSupported){
     float queuePriorities[]={1.0};
-    VkDeviceQueueCreateInfo queueInfo{};
-    queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    queueInfo.queueFamilyIndex = index;
-    queueInfo.queueCount = 1;
-    queueInfo.pQueuePriorities = queuePriorities;
+
+    // one queue per distinct family
+    uint32_t familyIndices[] = {families.graphics, families.transfer, families.compute};
+    VkDeviceQueueCreateInfo queueInfos[3]{};
+    uint32_t queueInfoCount = 0;
+
+    for(uint32_t index : familyIndices){
+        bool created = false;
+        for(uint32_t i=0;i<queueInfoCount;i++)
+            created = created || queueInfos[i].queueFamilyIndex == index;
+        if(created) continue;
+
+        VkDeviceQueueCreateInfo& queueInfo = queueInfos[queueInfoCount++];
+        queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queueInfo.queueFamilyIndex = index;
+        queueInfo.queueCount = 1;
+        queueInfo.pQueuePriorities = queuePriorities;
+    }
 
     // TODO: make vector later
     std::vector<const char*> extensions = {
         VK_KHR_SWAPCHAIN_EXTENSION_NAME,
     };
 
+    if(memoryBudgetSupported)
+        extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
     if(raytracingSupported){
         extensions.push_back(VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME);
         extensions.push_back(VK_KHR_RAY_QUERY_EXTENSION_NAME);
@@ -157,6 +203,7 @@ VkDevice createDevice(VkInstance instance, VkPhysicalDevice physicalDevice, uint
 	features12.descriptorBindingPartiallyBound = true;
 	features12.descriptorBindingVariableDescriptorCount = true;
 	features12.runtimeDescriptorArray = true;
+	features12.timelineSemaphore = true;
 
     if (raytracingSupported)
 		features12.bufferDeviceAddress = true;
@@ -185,8 +232,8 @@ VkDevice createDevice(VkInstance instance, VkPhysicalDevice physicalDevice, uint
 
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    createInfo.queueCreateInfoCount = 1;
-    createInfo.pQueueCreateInfos = &queueInfo;
+    createInfo.queueCreateInfoCount = queueInfoCount;
+    createInfo.pQueueCreateInfos = queueInfos;
     createInfo.ppEnabledExtensionNames = extensions.data();
     createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
     createInfo.pNext = &features2; 
@@ -16,8 +16,19 @@ VkSurfaceKHR createSurface(VkInstance instance, GLFWwindow* window);
 
 uint32_t getGraphicsFamilyIndex(VkPhysicalDevice physicalDevice);
 
+// Families that fall back to the graphics family when the device has no
+// dedicated one
+struct QueueFamilies{
+    uint32_t graphics;
+    uint32_t transfer; // transfer only family, fed by the copy engines
+    uint32_t compute; // compute family without graphics
+};
+
+QueueFamilies getQueueFamilies(VkPhysicalDevice physicalDevice);
+
 bool supportsPresentation(VkPhysicalDevice physicalDevice, uint32_t index, VkSurfaceKHR surface);
 
 VkPhysicalDevice selectPhysicalDevice(VkPhysicalDevice* physicalDevices, uint32_t physicalDeviceCount, VkSurfaceKHR surface);
 
-VkDevice createDevice(VkInstance instance, VkPhysicalDevice physicalDevice, uint32_t index, bool raytracingSupported, bool unifiedlayoutSupported);
\ No newline at end of file
+VkDevice createDevice(VkInstance instance, VkPhysicalDevice physicalDevice, const QueueFamilies& families, bool raytracingSupported, bool unifiedlayoutSupported,
+    bool memoryBudgetSupported);
\ No newline at end of file
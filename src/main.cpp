@@ -2,19 +2,16 @@
 #include "device.h"
 #include "swapchain.h"
 #include "program.h"
-#include <fast_obj.h>
+#include "memory.h"
+#include "upload.h"
+#include "mesh.h"
 
 #define _Debug
 
 #define DEVICE_COUNT 16
 #define MAX_FRAMES_IN_FLIGHT 2
-
-struct Buffer{
-    VkBuffer buffer;
-    VkDeviceMemory memory;
-    void* data;
-    size_t size;
-};
+// Upload 16 byte PackedVertex instead of the 32 byte Vertex
+#define PACKED_VERTICES 1
 
 // const std::vector<Vertex> vertices = {
 //     {{0.0f,-0.5f, 0.5f},{1.0f,0.0f,0.0f}},
@@ -26,105 +23,6 @@ struct Buffer{
 //     0,1,2,2,3,0
 // };
 
-struct VertexHash{
-    size_t operator()(const Vertex& ver) const noexcept{
-        auto h1 = std::hash<float>{}(ver.pos.x);
-        auto h2 = std::hash<float>{}(ver.pos.y);
-        auto h3 = std::hash<float>{}(ver.pos.z);
-
-        auto h4 = std::hash<float>{}(ver.color.x);
-        auto h5 = std::hash<float>{}(ver.color.y);
-        auto h6 = std::hash<float>{}(ver.color.z);
-
-        auto h7 = std::hash<float>{}(ver.texCoord.x);
-        auto h8 = std::hash<float>{}(ver.texCoord.y);
-
-        size_t seed = 0;
-        auto hashCombine = [&seed](size_t h) {
-            seed ^= h + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-        };
-
-        hashCombine(h1);
-        hashCombine(h2);
-        hashCombine(h3);
-        hashCombine(h4);
-        hashCombine(h5);
-        hashCombine(h6);
-        hashCombine(h7);
-        hashCombine(h8);
-
-        return seed;
-    }
-};
-
-uint32_t selectMemoryType(const VkPhysicalDeviceMemoryProperties &memoryProperties,
-    uint32_t memoryTypeBits, VkMemoryPropertyFlags flags){
-    for(uint32_t i =0; i<memoryProperties.memoryTypeCount; i++){
-        // memoryTypeBits is a bitmask
-        // its an unsigned 32 bit value and each bit is a "memory type index"
-        // we shift left i amount of types to check our current memory index properties
-        // if it returns 0 that memory type is not available for us
-        // if true then we determine if that index has the property flags that we want
-        if((memoryTypeBits & (1 << i)) != 0 && (memoryProperties.memoryTypes[i].propertyFlags & flags) == flags){
-            return i; // return the hopefully valid memory index
-        }
-    }
-
-    // if not found force an assert and return max int
-    assert(!"Unable to find compatible memory type");
-    return ~0u;
-}
-
-void createBuffer(Buffer &result, VkDevice device, const VkPhysicalDeviceMemoryProperties& memoryProperties,
-    size_t size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryFlags){
-    VkBufferCreateInfo createInfo{};
-    createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    createInfo.size = size;
-    createInfo.usage = usage;
-
-    VkBuffer buffer = 0;
-    VK_CHECK(vkCreateBuffer(device, &createInfo, 0, &buffer));
-    
-    VkMemoryRequirements memoryRequirements;
-    vkGetBufferMemoryRequirements(device, buffer, &memoryRequirements);
-
-    uint32_t memoryTypeIndex = selectMemoryType(memoryProperties, memoryRequirements.memoryTypeBits, memoryFlags);
-    assert(memoryTypeIndex != ~0u); // if uint max returned no memory available
-
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memoryRequirements.size;
-    allocInfo.memoryTypeIndex = memoryTypeIndex;
-
-    VkMemoryAllocateFlagsInfo flagInfo{};
-    flagInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
-
-    if(usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT){
-        allocInfo.pNext = &flagInfo;
-        flagInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
-        flagInfo.deviceMask = 1;
-    }
-
-    VkDeviceMemory memory = 0;
-    VK_CHECK(vkAllocateMemory(device, &allocInfo, 0, &memory));
-    VK_CHECK(vkBindBufferMemory(device, buffer, memory, 0));
-
-    void* data = 0;
-    if(memoryFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT){
-        VK_CHECK(vkMapMemory(device, memory, 0, size, 0, &data));
-    }
-
-    result.buffer = buffer;
-    result.memory = memory;
-    result.data = data;
-    result.size = size;
-}
-
-void destroyBuffer(const Buffer& buffer, VkDevice device){
-    vkDestroyBuffer(device, buffer.buffer, 0);
-    vkFreeMemory(device, buffer.memory, 0);
-}
-
 void createImageViews(VkDevice device, Swapchain swapchain, VkFormat format, std::vector<VkImageView> &imageViews){
     imageViews.resize(swapchain.imageCount);
 
@@ -190,57 +88,24 @@ VkFence createFence(VkDevice device){
     return fence;
 }
 
-bool loadModel(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, const char* path){
-    fastObjMesh* obj = fast_obj_read(path);
-    if(!obj){
-        printf("failed to load\n");
-        return false;
+// Change of a heap's bytes over budget worth another warning
+#define EVICT_WARNING_STEP (1ull << 20)
+
+// The hook runs every frame while a heap is over, userData holds the amount
+// last reported per heap and only changes of EVICT_WARNING_STEP are logged.
+// A heap back under its budget starts a new episode that is always logged
+void evictWarning(DeviceAllocator& allocator, uint32_t heapIndex, VkDeviceSize bytesOver, void* userData){
+    VkDeviceSize& reported = ((VkDeviceSize*)userData)[heapIndex];
+    if(bytesOver == 0){
+        reported = 0;
+        return;
     }
 
-    size_t vertexOffset = 0;
-    size_t indexOffset = 0;
-
-    std::unordered_map<Vertex, uint32_t, VertexHash> uniqueVertices;
+    VkDeviceSize change = bytesOver > reported ? bytesOver - reported : reported - bytesOver;
+    if(reported != 0 && change < EVICT_WARNING_STEP) return;
 
-    // Vertex : Vec2 pos & Vec3 color
-    for(unsigned int i=0;i<obj->face_count; i++){
-        for(unsigned int j=0;j<obj->face_vertices[i]-2;j++){
-            fastObjIndex indexX = obj->indices[indexOffset];
-            fastObjIndex indexY = obj->indices[indexOffset+j+1];
-            fastObjIndex indexZ = obj->indices[indexOffset+j+2];
-
-            fastObjIndex triIdx[3] = {indexX,indexY,indexZ};
-
-            for(unsigned k=0;k<3;k++){
-                float px = obj->positions[3*triIdx[k].p+0];
-                float py = obj->positions[3*triIdx[k].p+1];
-                float pz = obj->positions[3*triIdx[k].p+2];
-
-                glm::vec3 pos = {px,py,pz};
-                glm::vec3 color = {1.0f,1.0f,0.0f};
-                glm::vec2 texCoord = {0.0f,0.0f};
-
-                if(triIdx[k].t != 0){
-                    float u = obj->texcoords[2*triIdx[k].t+0];
-                    float v = obj->texcoords[2*triIdx[k].t+1];
-                    texCoord = {u,v};
-                }
-
-                Vertex vert = {pos,color,texCoord};
-
-                if(!uniqueVertices.contains(vert)){
-                    uint32_t idx = static_cast<uint32_t>(vertices.size());
-                    uniqueVertices[vert] = idx;
-                    vertices.push_back(vert); 
-                }
-
-                indices.push_back(uniqueVertices[vert]);
-            }
-        }
-        indexOffset += obj->face_vertices[i];
-    }
-
-    return true;
+    reported = bytesOver;
+    printf("Warning: heap %u is %.1f MB over its budget\n", heapIndex, bytesOver / (1024.0*1024.0));
 }
 
 int main(int argc, char *argv[]){
@@ -260,6 +125,7 @@ int main(int argc, char *argv[]){
 
     bool raytracingSupported = false;
     bool unifiedlayoutsSupported = false;
+    bool memoryBudgetSupported = false;
 
     uint32_t extensionCount = 0;
     VK_CHECK(vkEnumerateDeviceExtensionProperties(physicalDevice, 0, &extensionCount, 0));
@@ -270,14 +136,31 @@ int main(int argc, char *argv[]){
     for(auto &ext : extensionsCheck){
         raytracingSupported = raytracingSupported || strcmp(ext.extensionName, VK_KHR_RAY_QUERY_EXTENSION_NAME) == 0;
 		unifiedlayoutsSupported = unifiedlayoutsSupported || strcmp(ext.extensionName, "VK_KHR_unified_image_layouts") == 0;
+        memoryBudgetSupported = memoryBudgetSupported || strcmp(ext.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0;
     }
 
-    uint32_t familyIndex = getGraphicsFamilyIndex(physicalDevice);
-    VkDevice device = createDevice(instance, physicalDevice, familyIndex, raytracingSupported, unifiedlayoutsSupported);
+    QueueFamilies queueFamilies = getQueueFamilies(physicalDevice);
+    printf("Queue families: graphics %u, transfer %u, compute %u\n",
+        queueFamilies.graphics, queueFamilies.transfer, queueFamilies.compute);
+
+    uint32_t familyIndex = queueFamilies.graphics;
+    VkDevice device = createDevice(instance, physicalDevice, queueFamilies, raytracingSupported, unifiedlayoutsSupported,
+        memoryBudgetSupported);
 
     VkQueue graphicsQueue = 0;
     vkGetDeviceQueue(device, familyIndex, 0, &graphicsQueue);
 
+    // uploads run here so they never wait behind rendering
+    VkQueue transferQueue = 0;
+    vkGetDeviceQueue(device, queueFamilies.transfer, 0, &transferQueue);
+
+    DeviceAllocator deviceAllocator;
+    createDeviceAllocator(deviceAllocator, physicalDevice, device, raytracingSupported, memoryBudgetSupported, familyIndex,
+        queueFamilies.transfer);
+    // nothing is streamed yet, so there is nothing to evict either
+    VkDeviceSize evictReported[VK_MAX_MEMORY_HEAPS] = {};
+    setDeviceEvictionHook(deviceAllocator, evictWarning, evictReported);
+
     VkFormat swapchainFormat = getSwapchainFormat(physicalDevice, surface);
     
     Swapchain swapchain;
@@ -300,9 +183,15 @@ int main(int argc, char *argv[]){
     bool result = loadShaders(shaders, argv[0], "spirv/");
     assert(result);
 
+#if PACKED_VERTICES
+    Program mainProgram = createProgram(device, VK_PIPELINE_BIND_POINT_GRAPHICS, {&shaders["vertexshader_packed.vert"],&shaders["fragshader.frag"]},sizeof(VertexDecode),0);
+
+    VkPipeline graphicsPipeline = createGraphicsPipeline(device, VK_NULL_HANDLE, vertBufferInfo, mainProgram,{},VertexFormat_Packed);
+#else
     Program mainProgram = createProgram(device, VK_PIPELINE_BIND_POINT_GRAPHICS, {&shaders["vertexshader.vert"],&shaders["fragshader.frag"]},0,0);
   
     VkPipeline graphicsPipeline = createGraphicsPipeline(device, VK_NULL_HANDLE, vertBufferInfo, mainProgram,{});
+#endif
  
     VkCommandPool commandPool = createCommandPool(device, familyIndex);
     
@@ -320,39 +209,77 @@ int main(int argc, char *argv[]){
         renderFinishedSemaphores[i] = createSemaphore(device);
         inFlightFences[i] = createFence(device);
     }
+
+    // per frame CPU data lives here, a frame's arena is only reset after its
+    // fence signalled so the GPU may still read it while the frame is in flight
+    FrameArenas frameArenas = frameArenasNew(MAX_FRAMES_IN_FLIGHT);
     
  
     // TODO: make scene or model header
-    std::vector<Vertex> vertices;
-    std::vector<uint32_t> indices;
-    assert(loadModel(vertices, indices, "assets/crocodile/crocodile.obj"));
+    Allocator assetArena = arenaNew(ARENA_DEFAULT_RESERVE, Arena_Growable);
+    Vector<Vertex> vertices(assetArena);
+    Vector<uint32_t> indices(assetArena);
+    // parsed once, later runs map the cache written next to the model
+    MeshCache model;
+    bool loaded = loadMesh(model, vertices, indices, "assets/crocodile/crocodile.obj");
+    assert(loaded);
+
+    // static geometry lives in device local memory and is only touched by
+    // the CPU through the staging ring
+    Uploader uploader;
+    createUploader(uploader, deviceAllocator, transferQueue, queueFamilies.transfer, familyIndex);
+
+    // every mesh shares these two buffers, the scene binds them once
+    GeometryPool geometry(assetArena);
+    Mesh mesh{};
+#if PACKED_VERTICES
+    createGeometryPool(geometry, deviceAllocator, sizeof(PackedVertex));
+
+    VertexDecode vertexDecode = getVertexDecode(model.header.boundsMin, model.header.boundsMax);
+    bool uploaded = false;
+    {
+        Scratch scratch;
+        PackedVertex* packed = (PackedVertex*)alloc(scratch.allocator(), model.header.vertexCount * sizeof(PackedVertex), alignof(PackedVertex));
+        // normals from the full mesh only, the coarser levels follow it
+        packVertices(packed, model.vertices, model.header.vertexCount, model.indices, model.header.lods[0].indexCount,
+            model.header.boundsMin, model.header.boundsMax);
+        uploaded = uploadMesh(geometry, uploader, packed, model.header.vertexCount, model.indices, model.header.indexCount, mesh,
+            model.header.lods, model.header.lodCount);
+    }
+#else
+    createGeometryPool(geometry, deviceAllocator, sizeof(Vertex));
 
-    VkPhysicalDeviceMemoryProperties memoryProperties;
-    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
-   
-    // TODO: figure out how to upload data 
-    Buffer vertexBuffer{};
-    createBuffer(vertexBuffer, device, memoryProperties, vertices.size()*sizeof(Vertex), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, 
-    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-    
-    memcpy(vertexBuffer.data, vertices.data(), sizeof(Vertex)*vertices.size());
-    vkUnmapMemory(device, vertexBuffer.memory);
+    bool uploaded = uploadMesh(geometry, uploader, model.vertices, model.header.vertexCount, model.indices, model.header.indexCount, mesh,
+        model.header.lods, model.header.lodCount);
+#endif
+    assert(uploaded);
+    // the uploader copied the streams into its staging ring
+    closeMeshCache(model);
+    // frames render without the mesh until this batch is acquired
+    uint64_t geometryUploaded = flushUploads(uploader);
 
-    Buffer indexBuffer{};
-    createBuffer(indexBuffer, device, memoryProperties, indices.size()*sizeof(uint32_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    // per draw constants, written each frame straight into mapped memory
+    FrameUniforms frameUniforms;
+    createFrameUniforms(frameUniforms, deviceAllocator, MAX_FRAMES_IN_FLIGHT);
 
-    memcpy(indexBuffer.data, indices.data(), sizeof(uint32_t)*indices.size());
-    vkUnmapMemory(device, indexBuffer.memory);
+    // the geometry pool hands out device addresses so it is never moved,
+    // only streamed buffers would be registered here
+    Defragmenter defrag(assetArena);
+
+    printDeviceHeapStats(deviceAllocator);
 
     VkClearColorValue clearColor = {0.3f,0.6f,0.6f,1.0f};
 
     uint32_t currentFrame = 0;
+    uint64_t frameNumber = 0;
+    uint32_t meshLod = 0;
     while(!glfwWindowShouldClose(window)){
         glfwPollEvents();
     
         vkQueueWaitIdle(graphicsQueue);
         vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+        Allocator& frameArena = frameArenaBegin(frameArenas, currentFrame);
+        frameUniformsBegin(frameUniforms, currentFrame);
 
         uint32_t imageIndex = 0;
         vkAcquireNextImageKHR(device, swapchain.swapchain, UINT64_MAX, imageAvailableSemaphores[currentFrame],
@@ -367,6 +294,13 @@ int main(int argc, char *argv[]){
         beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
         VK_CHECK(vkBeginCommandBuffer(commandBuffers[currentFrame],&beginInfo));
+
+        uint64_t uploadWaitValue = acquireUploads(uploader);
+
+        updateDeviceBudget(deviceAllocator);
+        // a buffer moved while the transfer queue still writes it would lose those writes
+        if(uploader.acquiredValue == uploader.timelineValue)
+            defragmentStep(defrag, deviceAllocator, commandBuffers[currentFrame], frameNumber, MAX_FRAMES_IN_FLIGHT);
         
         vkCmdBindPipeline(commandBuffers[currentFrame],VK_PIPELINE_BIND_POINT_GRAPHICS,graphicsPipeline);
 
@@ -394,7 +328,10 @@ int main(int argc, char *argv[]){
         
         // add rendering info
         //need to change this from hard coded value later
-        VkRenderingAttachmentInfo vertBufferAttachment{};
+        // attachments are built in frame memory so their count can vary per frame
+        VkRenderingAttachmentInfo* colorAttachments = (VkRenderingAttachmentInfo*)arenaPushN(frameArena, VkRenderingAttachmentInfo, 1);
+        VkRenderingAttachmentInfo& vertBufferAttachment = colorAttachments[0];
+        vertBufferAttachment = {};
         vertBufferAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
         vertBufferAttachment.imageView = swapchainImageViews[imageIndex];
         vertBufferAttachment.imageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL;
@@ -409,7 +346,7 @@ int main(int argc, char *argv[]){
         passInfo.renderArea.extent.height = swapchain.height;
         passInfo.layerCount = 1;
         passInfo.colorAttachmentCount = 1;
-        passInfo.pColorAttachments = &vertBufferAttachment;
+        passInfo.pColorAttachments = colorAttachments;
         passInfo.pDepthAttachment = VK_NULL_HANDLE; // need to add later
 
         vkCmdBeginRendering(commandBuffers[currentFrame], &passInfo);
@@ -423,11 +360,18 @@ int main(int argc, char *argv[]){
         vkCmdSetCullMode(commandBuffers[currentFrame], VK_CULL_MODE_NONE);
         vkCmdSetDepthBias(commandBuffers[currentFrame], 0.0,0.0, 1.0);
 
-        VkBuffer vertexBuffers[] = {vertexBuffer.buffer};
+        VkBuffer vertexBuffers[] = {geometry.vertices.buffer};
         VkDeviceSize offsets[] = {0};
         vkCmdBindVertexBuffers(commandBuffers[currentFrame],0,1,vertexBuffers, offsets);
-        vkCmdBindIndexBuffer(commandBuffers[currentFrame], indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT16);
-        vkCmdDrawIndexed(commandBuffers[currentFrame],static_cast<uint32_t>(indices.size()), 1,0,0,0);
+        vkCmdBindIndexBuffer(commandBuffers[currentFrame], geometry.indices.buffer, 0, mesh.indexType);
+#if PACKED_VERTICES
+        vkCmdPushConstants(commandBuffers[currentFrame], mainProgram.layout, mainProgram.pushConstantStages, 0, sizeof(vertexDecode), &vertexDecode);
+#endif
+        // positions go straight to clip space, so a unit spans half the viewport
+        meshLod = selectMeshLod(mesh, meshLod, swapchain.height * 0.5f);
+        const MeshLod& lod = mesh.lods[meshLod];
+        if(uploader.acquiredValue >= geometryUploaded)
+            vkCmdDrawIndexed(commandBuffers[currentFrame], lod.indexCount, 1, mesh.firstIndex + lod.firstIndex, mesh.vertexOffset, 0);
        
         vkCmdEndRendering(commandBuffers[currentFrame]);
 
@@ -449,9 +393,18 @@ int main(int argc, char *argv[]){
         VkSubmitInfo submitInfo{};
         submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-        VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
-        VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-        submitInfo.waitSemaphoreCount = 1;
+        VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame], uploader.timeline};
+        VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT};
+        // the binary semaphore ignores its value
+        uint64_t waitValues[] = {0, uploadWaitValue};
+
+        VkTimelineSemaphoreSubmitInfo timelineInfo{};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.waitSemaphoreValueCount = uploadWaitValue ? 2 : 1;
+        timelineInfo.pWaitSemaphoreValues = waitValues;
+
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.waitSemaphoreCount = uploadWaitValue ? 2 : 1;
         submitInfo.pWaitSemaphores = waitSemaphores;
         submitInfo.pWaitDstStageMask = waitStages;
         submitInfo.commandBufferCount = 1;
@@ -480,12 +433,17 @@ int main(int argc, char *argv[]){
         
         // always within [0, MAX_FRAMES_IN_FLIGHT]
         currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+        frameNumber++;
     }
 
     vkDeviceWaitIdle(device);
 
-    destroyBuffer(indexBuffer, device);
-    destroyBuffer(vertexBuffer, device);
+    destroyUploader(uploader, deviceAllocator);
+    destroyDefragmenter(defrag, deviceAllocator);
+    destroyFrameUniforms(frameUniforms, deviceAllocator);
+    destroyGeometryPool(geometry, deviceAllocator);
+    arenaFree(assetArena);
+    frameArenasFree(frameArenas);
     for(int i=0;i<MAX_FRAMES_IN_FLIGHT;i++){
         vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
         vkDestroySemaphore(device, renderFinishedSemaphores[i],nullptr);
@@ -502,6 +460,7 @@ int main(int argc, char *argv[]){
     vkDestroyPipeline(device, graphicsPipeline, nullptr);
     destroyProgram(device, mainProgram);
     vkDestroySwapchainKHR(device, swapchain.swapchain, nullptr);
+    destroyDeviceAllocator(deviceAllocator);
     vkDestroyDevice(device, nullptr);
     vkDestroySurfaceKHR(instance, surface, nullptr);
     vkDestroyInstance(instance, nullptr);
@@ -0,0 +1,557 @@
+#include "memory.h"
+
+#include <new>
+
+bool rangeAlloc(RangeAllocator& ranges, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset){
+    for(uint64_t i=0;i<ranges.free.size;i++){
+        DeviceRange range = ranges.free[i];
+        VkDeviceSize start = alignPow2(range.offset, alignment);
+        if(start + size > range.offset + range.size) continue;
+
+        // the alignment gap in front and the tail behind stay free
+        VkDeviceSize tail = range.offset + range.size - (start + size);
+        if(start > range.offset){
+            ranges.free[i].size = start - range.offset;
+            if(tail > 0)
+                ranges.free.insert(i+1, {start + size, tail});
+        }else if(tail > 0){
+            ranges.free[i] = {start + size, tail};
+        }else{
+            ranges.free.remove(i);
+        }
+
+        ranges.used += size;
+        offset = start;
+        return true;
+    }
+
+    return false;
+}
+
+void rangeFree(RangeAllocator& ranges, VkDeviceSize offset, VkDeviceSize size){
+    // first free range past offset
+    uint64_t lo = 0;
+    uint64_t hi = ranges.free.size;
+    while(lo < hi){
+        uint64_t mid = (lo + hi) / 2;
+        if(ranges.free[mid].offset < offset) lo = mid + 1;
+        else hi = mid;
+    }
+
+    bool mergePrev = lo > 0 && ranges.free[lo-1].offset + ranges.free[lo-1].size == offset;
+    bool mergeNext = lo < ranges.free.size && offset + size == ranges.free[lo].offset;
+
+    if(mergePrev && mergeNext){
+        ranges.free[lo-1].size += size + ranges.free[lo].size;
+        ranges.free.remove(lo);
+    }else if(mergePrev){
+        ranges.free[lo-1].size += size;
+    }else if(mergeNext){
+        ranges.free[lo].offset = offset;
+        ranges.free[lo].size += size;
+    }else{
+        ranges.free.insert(lo, {offset, size});
+    }
+
+    assert(ranges.used >= size);
+    ranges.used -= size;
+}
+
+uint32_t selectMemoryType(const VkPhysicalDeviceMemoryProperties &memoryProperties,
+    uint32_t memoryTypeBits, VkMemoryPropertyFlags flags){
+    for(uint32_t i =0; i<memoryProperties.memoryTypeCount; i++){
+        // memoryTypeBits is a bitmask
+        // its an unsigned 32 bit value and each bit is a "memory type index"
+        // we shift left i amount of types to check our current memory index properties
+        // if it returns 0 that memory type is not available for us
+        // if true then we determine if that index has the property flags that we want
+        if((memoryTypeBits & (1 << i)) != 0 && (memoryProperties.memoryTypes[i].propertyFlags & flags) == flags){
+            return i; // return the hopefully valid memory index
+        }
+    }
+
+    // if not found force an assert and return max int
+    assert(!"Unable to find compatible memory type");
+    return ~0u;
+}
+
+void createDeviceAllocator(DeviceAllocator& result, VkPhysicalDevice physicalDevice, VkDevice device,
+    bool deviceAddress, bool memoryBudget, uint32_t graphicsFamily, uint32_t transferFamily){
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    result = {};
+    result.physicalDevice = physicalDevice;
+    result.device = device;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &result.memoryProperties);
+    result.bufferImageGranularity = properties.limits.bufferImageGranularity;
+    result.maxAllocationCount = properties.limits.maxMemoryAllocationCount;
+    result.minUniformAlignment = properties.limits.minUniformBufferOffsetAlignment;
+    result.minStorageAlignment = properties.limits.minStorageBufferOffsetAlignment;
+    result.deviceAddress = deviceAddress;
+    result.memoryBudget = memoryBudget;
+    result.queueFamilies[0] = graphicsFamily;
+    result.queueFamilies[1] = transferFamily;
+    result.queueFamilyCount = graphicsFamily == transferFamily ? 1 : 2;
+    result.metadata = tlsfNew(1 << 20);
+
+    updateDeviceBudget(result);
+}
+
+void destroyDeviceAllocator(DeviceAllocator& allocator){
+    for(uint32_t i=0;i<VK_MAX_MEMORY_TYPES;i++){
+        for(uint32_t kind=0;kind<DEVICE_RESOURCE_KINDS;kind++){
+            for(DeviceBlock* block = allocator.blocks[i][kind]; block; block = block->next){
+                assert(block->ranges.used == 0); // resources still alive
+                // freeing memory also unmaps it
+                vkFreeMemory(allocator.device, block->memory, 0);
+            }
+            allocator.blocks[i][kind] = nullptr;
+        }
+    }
+
+    tlsfFree(allocator.metadata);
+}
+
+// Counts bytes about to be allocated from heapIndex against its budget, making
+// room first when they would pass the threshold
+static void reserveBudget(DeviceAllocator& allocator, uint32_t heapIndex, VkDeviceSize bytes){
+    DeviceHeapBudget& budget = allocator.heapBudgets[heapIndex];
+    VkDeviceSize limit = (VkDeviceSize)(budget.budget * DEVICE_BUDGET_THRESHOLD);
+
+    if(budget.usage + bytes > limit){
+        trimDeviceMemory(allocator);
+
+        if(budget.usage + bytes > limit && allocator.evict){
+            allocator.evict(allocator, heapIndex, budget.usage + bytes - limit, allocator.evictUserData);
+            allocator.heapOverBudget[heapIndex] = true;
+        }
+    }
+
+    budget.usage += bytes;
+}
+
+static void releaseBudget(DeviceAllocator& allocator, uint32_t heapIndex, VkDeviceSize bytes){
+    DeviceHeapBudget& budget = allocator.heapBudgets[heapIndex];
+    budget.usage = budget.usage > bytes ? budget.usage - bytes : 0;
+}
+
+static VkDeviceSize getBlockSize(const DeviceAllocator& allocator, uint32_t memoryType){
+    uint32_t heapIndex = allocator.memoryProperties.memoryTypes[memoryType].heapIndex;
+    VkDeviceSize heapSize = allocator.memoryProperties.memoryHeaps[heapIndex].size;
+
+    // small heaps such as the 256MB BAR window would fit one block only
+    return heapSize <= (1ull << 30) ? heapSize / 8 : DEVICE_BLOCK_SIZE;
+}
+
+static VkDeviceMemory allocateMemory(DeviceAllocator& allocator, VkDeviceSize size, uint32_t memoryType, void** mapped){
+    assert(allocator.allocationCount < allocator.maxAllocationCount);
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryType;
+
+    // any buffer in a block may ask for its device address
+    VkMemoryAllocateFlagsInfo flagInfo{};
+    flagInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
+
+    if(allocator.deviceAddress){
+        allocInfo.pNext = &flagInfo;
+        flagInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+    }
+
+    VkDeviceMemory memory = 0;
+    VK_CHECK(vkAllocateMemory(allocator.device, &allocInfo, 0, &memory));
+    allocator.allocationCount++;
+
+    *mapped = 0;
+    if(allocator.memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT){
+        VK_CHECK(vkMapMemory(allocator.device, memory, 0, VK_WHOLE_SIZE, 0, mapped));
+    }
+
+    return memory;
+}
+
+DeviceAllocation allocateDeviceMemory(DeviceAllocator& allocator, const VkMemoryRequirements& requirements,
+    VkMemoryPropertyFlags memoryFlags, DeviceResourceKind kind){
+    uint32_t memoryType = selectMemoryType(allocator.memoryProperties, requirements.memoryTypeBits, memoryFlags);
+    assert(memoryType != ~0u); // if uint max returned no memory available
+
+    uint32_t heapIndex = allocator.memoryProperties.memoryTypes[memoryType].heapIndex;
+    DeviceHeapStats& stats = allocator.heapStats[heapIndex];
+
+    DeviceAllocation result{};
+    result.size = requirements.size;
+    result.memoryType = memoryType;
+    result.kind = kind;
+
+    // resources larger than half a block would leave most of it unusable
+    VkDeviceSize blockSize = getBlockSize(allocator, memoryType);
+    if(requirements.size > blockSize / 2){
+        reserveBudget(allocator, heapIndex, requirements.size);
+        result.memory = allocateMemory(allocator, requirements.size, memoryType, &result.data);
+        result.offset = 0;
+        result.block = nullptr;
+
+        stats.blockBytes += requirements.size;
+        stats.usedBytes += requirements.size;
+        stats.allocationCount++;
+        stats.dedicatedCount++;
+        return result;
+    }
+
+    // linear and optimal resources sharing a granularity page would alias,
+    // keeping them in separate blocks avoids ever placing them side by side
+    uint32_t kindIndex = allocator.bufferImageGranularity > 1 ? kind : DeviceResource_Linear;
+
+    DeviceBlock* block = allocator.blocks[memoryType][kindIndex];
+    VkDeviceSize offset = 0;
+    for(; block; block = block->next){
+        if(block->evacuating) continue;
+        if(rangeAlloc(block->ranges, requirements.size, requirements.alignment, offset))
+            break;
+    }
+
+    if(!block){
+        reserveBudget(allocator, heapIndex, blockSize);
+
+        void* mapped = 0;
+        VkDeviceMemory memory = allocateMemory(allocator, blockSize, memoryType, &mapped);
+
+        void* blockMemory = alloc(allocator.metadata, sizeof(DeviceBlock), alignof(DeviceBlock));
+        block = new (blockMemory) DeviceBlock{memory, blockSize, mapped,
+            RangeAllocator(allocator.metadata, blockSize), allocator.blocks[memoryType][kindIndex], false, false};
+        allocator.blocks[memoryType][kindIndex] = block;
+
+        stats.blockBytes += blockSize;
+        stats.blockCount++;
+
+        bool allocated = rangeAlloc(block->ranges, requirements.size, requirements.alignment, offset);
+        assert(allocated);
+    }
+
+    result.memory = block->memory;
+    result.offset = offset;
+    result.data = block->mapped ? (uint8_t*)block->mapped + offset : 0;
+    result.block = block;
+
+    stats.usedBytes += requirements.size;
+    stats.allocationCount++;
+    return result;
+}
+
+void freeDeviceMemory(DeviceAllocator& allocator, const DeviceAllocation& allocation){
+    uint32_t heapIndex = allocator.memoryProperties.memoryTypes[allocation.memoryType].heapIndex;
+    DeviceHeapStats& stats = allocator.heapStats[heapIndex];
+
+    stats.usedBytes -= allocation.size;
+    stats.allocationCount--;
+
+    if(!allocation.block){
+        vkFreeMemory(allocator.device, allocation.memory, 0);
+        allocator.allocationCount--;
+
+        stats.blockBytes -= allocation.size;
+        stats.dedicatedCount--;
+        releaseBudget(allocator, heapIndex, allocation.size);
+        return;
+    }
+
+    // empty blocks stay around for the next resources of their type until
+    // trimDeviceMemory
+    rangeFree(allocation.block->ranges, allocation.offset, allocation.size);
+}
+
+void createBuffer(Buffer& result, DeviceAllocator& allocator, size_t size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryFlags){
+    VkBufferCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    createInfo.size = size;
+    createInfo.usage = usage;
+    // a buffer written on the transfer queue in one batch and read by the
+    // graphics queue may be written again by a later batch, concurrent sharing
+    // saves releasing it back and forth between the families
+    if(allocator.queueFamilyCount > 1){
+        createInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        createInfo.queueFamilyIndexCount = allocator.queueFamilyCount;
+        createInfo.pQueueFamilyIndices = allocator.queueFamilies;
+    }
+
+    VkBuffer buffer = 0;
+    VK_CHECK(vkCreateBuffer(allocator.device, &createInfo, 0, &buffer));
+
+    VkMemoryRequirements memoryRequirements;
+    vkGetBufferMemoryRequirements(allocator.device, buffer, &memoryRequirements);
+
+    // device addresses need every block allocated with the device address flag
+    assert(!(usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) || allocator.deviceAddress);
+
+    DeviceAllocation allocation = allocateDeviceMemory(allocator, memoryRequirements, memoryFlags, DeviceResource_Linear);
+    VK_CHECK(vkBindBufferMemory(allocator.device, buffer, allocation.memory, allocation.offset));
+
+    result.buffer = buffer;
+    result.allocation = allocation;
+    result.data = (memoryFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) ? allocation.data : 0;
+    result.size = size;
+    result.usage = usage;
+    result.memoryFlags = memoryFlags;
+}
+
+void destroyBuffer(const Buffer& buffer, DeviceAllocator& allocator){
+    vkDestroyBuffer(allocator.device, buffer.buffer, 0);
+    freeDeviceMemory(allocator, buffer.allocation);
+}
+
+DeviceAllocation allocateImageMemory(DeviceAllocator& allocator, VkImage image, VkMemoryPropertyFlags memoryFlags){
+    VkMemoryRequirements memoryRequirements;
+    vkGetImageMemoryRequirements(allocator.device, image, &memoryRequirements);
+
+    DeviceAllocation allocation = allocateDeviceMemory(allocator, memoryRequirements, memoryFlags, DeviceResource_Optimal);
+    VK_CHECK(vkBindImageMemory(allocator.device, image, allocation.memory, allocation.offset));
+
+    return allocation;
+}
+
+void printDeviceHeapStats(const DeviceAllocator& allocator){
+    for(uint32_t i=0;i<allocator.memoryProperties.memoryHeapCount;i++){
+        const DeviceHeapStats& stats = allocator.heapStats[i];
+        printf("Heap %u: %.1f/%.1f MB used in %u blocks, %u allocations (%u dedicated) of %.1f MB\n", i,
+            stats.usedBytes / (1024.0*1024.0), stats.blockBytes / (1024.0*1024.0), stats.blockCount,
+            stats.allocationCount, stats.dedicatedCount,
+            allocator.memoryProperties.memoryHeaps[i].size / (1024.0*1024.0));
+    }
+}
+
+void updateDeviceBudget(DeviceAllocator& allocator){
+    uint32_t heapCount = allocator.memoryProperties.memoryHeapCount;
+
+    if(allocator.memoryBudget){
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+        budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+        VkPhysicalDeviceMemoryProperties2 properties{};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+        properties.pNext = &budgetProperties;
+        vkGetPhysicalDeviceMemoryProperties2(allocator.physicalDevice, &properties);
+
+        for(uint32_t i=0;i<heapCount;i++)
+            allocator.heapBudgets[i] = {budgetProperties.heapUsage[i], budgetProperties.heapBudget[i]};
+    }else{
+        // only our own blocks are known, leaving a fifth of each heap covers
+        // other processes and the driver
+        for(uint32_t i=0;i<heapCount;i++)
+            allocator.heapBudgets[i] = {allocator.heapStats[i].blockBytes, allocator.memoryProperties.memoryHeaps[i].size / 5 * 4};
+    }
+
+    for(uint32_t i=0;i<heapCount;i++){
+        const DeviceHeapBudget& budget = allocator.heapBudgets[i];
+        VkDeviceSize limit = (VkDeviceSize)(budget.budget * DEVICE_BUDGET_THRESHOLD);
+        if(budget.usage <= limit){
+            if(allocator.heapOverBudget[i] && allocator.evict)
+                allocator.evict(allocator, i, 0, allocator.evictUserData);
+            allocator.heapOverBudget[i] = false;
+            continue;
+        }
+
+        trimDeviceMemory(allocator);
+
+        if(budget.usage > limit && allocator.evict){
+            allocator.evict(allocator, i, budget.usage - limit, allocator.evictUserData);
+            allocator.heapOverBudget[i] = true;
+        }
+    }
+}
+
+void setDeviceEvictionHook(DeviceAllocator& allocator, DeviceEvictFnPtr evict, void* userData){
+    allocator.evict = evict;
+    allocator.evictUserData = userData;
+}
+
+static void freeBlock(DeviceAllocator& allocator, uint32_t memoryType, DeviceBlock* block){
+    vkFreeMemory(allocator.device, block->memory, 0);
+    allocator.allocationCount--;
+
+    uint32_t heapIndex = allocator.memoryProperties.memoryTypes[memoryType].heapIndex;
+    DeviceHeapStats& stats = allocator.heapStats[heapIndex];
+    stats.blockBytes -= block->size;
+    stats.blockCount--;
+    releaseBudget(allocator, heapIndex, block->size);
+
+    Vector<DeviceRange>& ranges = block->ranges.free;
+    dealloc(allocator.metadata, ranges.capacity * sizeof(DeviceRange), ranges.data);
+    dealloc(allocator.metadata, sizeof(DeviceBlock), block);
+}
+
+void trimDeviceMemory(DeviceAllocator& allocator){
+    for(uint32_t i=0;i<VK_MAX_MEMORY_TYPES;i++){
+        for(uint32_t kind=0;kind<DEVICE_RESOURCE_KINDS;kind++){
+            bool keptEmpty = false;
+            DeviceBlock** link = &allocator.blocks[i][kind];
+
+            while(*link){
+                DeviceBlock* block = *link;
+
+                // a block emptied by the defragmenter is never the one kept
+                if(block->ranges.used > 0 || (!keptEmpty && !block->evacuating)){
+                    keptEmpty = keptEmpty || block->ranges.used == 0;
+                    link = &block->next;
+                    continue;
+                }
+
+                *link = block->next;
+                freeBlock(allocator, i, block);
+            }
+        }
+    }
+}
+
+void defragRegister(Defragmenter& defrag, Buffer* buffer){
+    assert((buffer->usage & VK_BUFFER_USAGE_TRANSFER_SRC_BIT) && (buffer->usage & VK_BUFFER_USAGE_TRANSFER_DST_BIT));
+    defrag.buffers.push(buffer);
+}
+
+void defragUnregister(Defragmenter& defrag, Buffer* buffer){
+    for(uint64_t i=0;i<defrag.buffers.size;i++){
+        if(defrag.buffers[i] == buffer){
+            defrag.buffers.remove(i);
+            return;
+        }
+    }
+}
+
+static bool blockExists(const DeviceAllocator& allocator, const DeviceBlock* block){
+    for(uint32_t i=0;i<VK_MAX_MEMORY_TYPES;i++)
+        for(uint32_t kind=0;kind<DEVICE_RESOURCE_KINDS;kind++)
+            for(DeviceBlock* it = allocator.blocks[i][kind]; it; it = it->next)
+                if(it == block) return true;
+
+    return false;
+}
+
+// Least used block whose contents fit in the free space of the other blocks
+// of its list
+static DeviceBlock* selectDefragSource(DeviceAllocator& allocator){
+    DeviceBlock* result = nullptr;
+    double best = DEFRAG_MAX_UTILIZATION;
+
+    for(uint32_t i=0;i<VK_MAX_MEMORY_TYPES;i++){
+        for(uint32_t kind=0;kind<DEVICE_RESOURCE_KINDS;kind++){
+            VkDeviceSize freeBytes = 0;
+            for(DeviceBlock* block = allocator.blocks[i][kind]; block; block = block->next)
+                freeBytes += block->size - block->ranges.used;
+
+            for(DeviceBlock* block = allocator.blocks[i][kind]; block; block = block->next){
+                if(block->pinned || block->ranges.used == 0) continue;
+
+                double utilization = (double)block->ranges.used / block->size;
+                VkDeviceSize freeElsewhere = freeBytes - (block->size - block->ranges.used);
+                if(utilization < best && block->ranges.used <= freeElsewhere){
+                    best = utilization;
+                    result = block;
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+void defragmentStep(Defragmenter& defrag, DeviceAllocator& allocator, VkCommandBuffer commandBuffer,
+    uint64_t frame, uint32_t framesInFlight){
+    // old copies of frames that finished
+    for(uint64_t i=0;i<defrag.retired.size;){
+        if(defrag.retired[i].frame + framesInFlight > frame){
+            i++;
+            continue;
+        }
+
+        destroyBuffer(defrag.retired[i].old, allocator);
+        defrag.retired.remove(i);
+    }
+
+    // trimmed elsewhere once it was emptied
+    if(defrag.source && !blockExists(allocator, defrag.source))
+        defrag.source = nullptr;
+
+    if(defrag.source){
+        bool moving = false;
+        for(Buffer* buffer : defrag.buffers)
+            moving = moving || buffer->allocation.block == defrag.source;
+        for(const DefragMove& move : defrag.retired)
+            moving = moving || move.old.allocation.block == defrag.source;
+
+        if(!moving){
+            // whatever is left belongs to resources we cannot move
+            if(defrag.source->ranges.used > 0){
+                defrag.source->pinned = true;
+                defrag.source->evacuating = false;
+            }
+            defrag.source = nullptr;
+        }
+    }
+
+    trimDeviceMemory(allocator);
+
+    if(!defrag.source){
+        defrag.source = selectDefragSource(allocator);
+        if(!defrag.source) return;
+        defrag.source->evacuating = true;
+    }
+
+    VkDeviceSize moved = 0;
+
+    for(Buffer* buffer : defrag.buffers){
+        if(moved >= DEFRAG_BYTES_PER_FRAME) break;
+        if(buffer->allocation.block != defrag.source) continue;
+
+        if(moved == 0){
+            // earlier writes to the buffers have to land before they are read
+            VkMemoryBarrier2 barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+            barrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+            barrier.srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT;
+            barrier.dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+            barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT;
+
+            VkDependencyInfo depInfo{};
+            depInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+            depInfo.memoryBarrierCount = 1;
+            depInfo.pMemoryBarriers = &barrier;
+            vkCmdPipelineBarrier2(commandBuffer, &depInfo);
+        }
+
+        Buffer old = *buffer;
+        createBuffer(*buffer, allocator, old.size, old.usage, old.memoryFlags);
+
+        VkBufferCopy region = {0, 0, old.size};
+        vkCmdCopyBuffer(commandBuffer, old.buffer, buffer->buffer, 1, &region);
+
+        defrag.retired.push({old, frame});
+        moved += old.size;
+    }
+
+    if(moved > 0){
+        VkMemoryBarrier2 barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+        barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+        barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+        barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+        barrier.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+        VkDependencyInfo depInfo{};
+        depInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        depInfo.memoryBarrierCount = 1;
+        depInfo.pMemoryBarriers = &barrier;
+        vkCmdPipelineBarrier2(commandBuffer, &depInfo);
+    }
+}
+
+void destroyDefragmenter(Defragmenter& defrag, DeviceAllocator& allocator){
+    for(const DefragMove& move : defrag.retired)
+        destroyBuffer(move.old, allocator);
+    defrag.retired.clear();
+
+    if(defrag.source && blockExists(allocator, defrag.source))
+        defrag.source->evacuating = false;
+    defrag.source = nullptr;
+}
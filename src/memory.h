@@ -0,0 +1,187 @@
+#pragma once
+#include "common.h"
+
+// Bytes of device memory allocated at once per memory type, smaller heaps use
+// an eighth of the heap instead
+#define DEVICE_BLOCK_SIZE (256ull << 20)
+// Number of block lists per memory type, linear resources (buffers) and
+// optimal tiling images get separate blocks when bufferImageGranularity > 1
+#define DEVICE_RESOURCE_KINDS 2
+// Fraction of a heap's budget past which the eviction hook runs
+#define DEVICE_BUDGET_THRESHOLD 0.9
+// Bytes the defragmenter copies per frame
+#define DEFRAG_BYTES_PER_FRAME (16ull << 20)
+// Blocks used below this fraction are emptied by the defragmenter
+#define DEFRAG_MAX_UTILIZATION 0.5
+
+enum DeviceResourceKind{
+    DeviceResource_Linear,
+    DeviceResource_Optimal,
+};
+
+struct DeviceRange{
+    VkDeviceSize offset;
+    VkDeviceSize size;
+};
+
+// First fit allocator of offsets into a range it does not own, free ranges are
+// kept sorted by offset and merged with their neighbours when freed
+struct RangeAllocator{
+    Vector<DeviceRange> free;
+    VkDeviceSize size;
+    VkDeviceSize used;
+
+    RangeAllocator(Allocator& allocator, VkDeviceSize size): free(allocator), size(size), used(0){
+        free.push({0, size});
+    }
+};
+
+bool rangeAlloc(RangeAllocator& ranges, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset);
+void rangeFree(RangeAllocator& ranges, VkDeviceSize offset, VkDeviceSize size);
+
+// One vkAllocateMemory, host visible blocks stay mapped for their lifetime
+struct DeviceBlock{
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    void* mapped;
+    RangeAllocator ranges;
+    DeviceBlock* next;
+    bool evacuating; // being emptied by the defragmenter, takes no new resources
+    bool pinned; // holds resources the defragmenter cannot move
+};
+
+struct DeviceAllocation{
+    VkDeviceMemory memory;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    // Persistent mapping of offset, null for memory that is not host visible
+    void* data;
+    uint32_t memoryType;
+    DeviceResourceKind kind;
+    // Null for dedicated allocations, which own their VkDeviceMemory
+    DeviceBlock* block;
+};
+
+struct DeviceHeapStats{
+    VkDeviceSize blockBytes;
+    VkDeviceSize usedBytes;
+    uint32_t blockCount;
+    uint32_t allocationCount;
+    uint32_t dedicatedCount;
+};
+
+// Bytes used by this process and bytes it can use before the driver starts
+// paging, from VK_EXT_memory_budget or estimated without it
+struct DeviceHeapBudget{
+    VkDeviceSize usage;
+    VkDeviceSize budget;
+};
+
+struct DeviceAllocator;
+
+// Called when a heap gets close to its budget, expected to free at least
+// bytesOver bytes of that heap. Called once more with bytesOver 0 when the
+// heap is back under its budget
+typedef void(*DeviceEvictFnPtr)(DeviceAllocator& allocator, uint32_t heapIndex, VkDeviceSize bytesOver, void* userData);
+
+// Sub allocates buffers and images out of large blocks per memory type so the
+// driver sees a handful of vkAllocateMemory calls instead of one per resource
+struct DeviceAllocator{
+    VkPhysicalDevice physicalDevice;
+    VkDevice device;
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    VkDeviceSize bufferImageGranularity;
+    uint32_t maxAllocationCount;
+    VkDeviceSize minUniformAlignment; // minUniformBufferOffsetAlignment
+    VkDeviceSize minStorageAlignment; // minStorageBufferOffsetAlignment
+    uint32_t allocationCount; // live vkAllocateMemory calls
+    bool deviceAddress; // blocks allocated with VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT
+    bool memoryBudget; // VK_EXT_memory_budget enabled
+    // Families that use buffers without ownership transfers, buffers are
+    // created concurrent when there are two
+    uint32_t queueFamilies[2];
+    uint32_t queueFamilyCount;
+
+    DeviceBlock* blocks[VK_MAX_MEMORY_TYPES][DEVICE_RESOURCE_KINDS];
+    DeviceHeapStats heapStats[VK_MAX_MEMORY_HEAPS];
+    DeviceHeapBudget heapBudgets[VK_MAX_MEMORY_HEAPS];
+    bool heapOverBudget[VK_MAX_MEMORY_HEAPS]; // the hook ran since the heap was last under
+
+    DeviceEvictFnPtr evict;
+    void* evictUserData;
+
+    // Blocks and their free range lists
+    Allocator metadata;
+};
+
+struct Buffer{
+    VkBuffer buffer;
+    DeviceAllocation allocation;
+    void* data;
+    size_t size;
+    // kept so the buffer can be recreated elsewhere
+    VkBufferUsageFlags usage;
+    VkMemoryPropertyFlags memoryFlags;
+};
+
+// Old copy of a moved buffer, destroyed once the frames that used it finished
+struct DefragMove{
+    Buffer old;
+    uint64_t frame;
+};
+
+// Moves buffers out of sparsely used blocks a few MB per frame so the emptied
+// blocks can be freed, only registered buffers are moved
+struct Defragmenter{
+    Vector<Buffer*> buffers;
+    Vector<DefragMove> retired;
+    DeviceBlock* source; // block being emptied
+
+    Defragmenter(Allocator& allocator): buffers(allocator), retired(allocator), source(nullptr){}
+};
+
+uint32_t selectMemoryType(const VkPhysicalDeviceMemoryProperties &memoryProperties,
+    uint32_t memoryTypeBits, VkMemoryPropertyFlags flags);
+
+// Buffers are shared between graphicsFamily and transferFamily when they differ
+void createDeviceAllocator(DeviceAllocator& result, VkPhysicalDevice physicalDevice, VkDevice device,
+    bool deviceAddress, bool memoryBudget, uint32_t graphicsFamily, uint32_t transferFamily);
+
+void destroyDeviceAllocator(DeviceAllocator& allocator);
+
+DeviceAllocation allocateDeviceMemory(DeviceAllocator& allocator, const VkMemoryRequirements& requirements,
+    VkMemoryPropertyFlags memoryFlags, DeviceResourceKind kind);
+
+void freeDeviceMemory(DeviceAllocator& allocator, const DeviceAllocation& allocation);
+
+void createBuffer(Buffer& result, DeviceAllocator& allocator, size_t size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryFlags);
+
+void destroyBuffer(const Buffer& buffer, DeviceAllocator& allocator);
+
+// Allocates and binds memory for an image created with optimal tiling
+DeviceAllocation allocateImageMemory(DeviceAllocator& allocator, VkImage image, VkMemoryPropertyFlags memoryFlags);
+
+void printDeviceHeapStats(const DeviceAllocator& allocator);
+
+// Refreshes heapBudgets and runs the eviction hook for heaps near their
+// budget, meant to be called once per frame
+void updateDeviceBudget(DeviceAllocator& allocator);
+
+void setDeviceEvictionHook(DeviceAllocator& allocator, DeviceEvictFnPtr evict, void* userData);
+
+// Frees empty blocks, keeping one per memory type and resource kind
+void trimDeviceMemory(DeviceAllocator& allocator);
+
+// Buffers need TRANSFER_SRC and TRANSFER_DST usage and must stay at the same
+// address until unregistered
+void defragRegister(Defragmenter& defrag, Buffer* buffer);
+void defragUnregister(Defragmenter& defrag, Buffer* buffer);
+
+// Records this frame's copies into commandBuffer ahead of any use of the moved
+// buffers. frame counts up by one per frame, old copies are destroyed once
+// framesInFlight newer frames started
+void defragmentStep(Defragmenter& defrag, DeviceAllocator& allocator, VkCommandBuffer commandBuffer,
+    uint64_t frame, uint32_t framesInFlight);
+
+// Destroys the remaining old copies, the GPU must be idle
+void destroyDefragmenter(Defragmenter& defrag, DeviceAllocator& allocator);
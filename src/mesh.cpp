@@ -0,0 +1,739 @@
+#include "mesh.h"
+#include <fast_obj.h>
+#include <new>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/packing.hpp>
+#include <glm/gtc/packing.hpp>
+
+static VkDeviceAddress getBufferAddress(VkDevice device, VkBuffer buffer){
+    VkBufferDeviceAddressInfo addressInfo{};
+    addressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+    addressInfo.buffer = buffer;
+    return vkGetBufferDeviceAddress(device, &addressInfo);
+}
+
+void createGeometryPool(GeometryPool& pool, DeviceAllocator& allocator, uint32_t vertexStride){
+    pool.vertexStride = vertexStride;
+
+    // storage and device address usage lets shaders pull vertices themselves
+    VkBufferUsageFlags usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    if(allocator.deviceAddress)
+        usage |= VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+
+    createBuffer(pool.vertices, allocator, (size_t)pool.vertexRanges.size * vertexStride,
+        usage | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    createBuffer(pool.indices, allocator, (size_t)pool.indexRanges.size * sizeof(uint16_t),
+        usage | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    if(allocator.deviceAddress){
+        pool.vertexAddress = getBufferAddress(allocator.device, pool.vertices.buffer);
+        pool.indexAddress = getBufferAddress(allocator.device, pool.indices.buffer);
+    }
+}
+
+void destroyGeometryPool(GeometryPool& pool, DeviceAllocator& allocator){
+    destroyBuffer(pool.indices, allocator);
+    destroyBuffer(pool.vertices, allocator);
+}
+
+// 16 bit slots an index of type takes in the pool
+static uint32_t getIndexSlots(VkIndexType indexType){
+    return indexType == VK_INDEX_TYPE_UINT32 ? 2 : 1;
+}
+
+bool geometryAlloc(GeometryPool& pool, uint32_t vertexCount, uint32_t indexCount, Mesh& result){
+    // indices are relative to the mesh's first vertex, 0xffff stays free as
+    // the restart value
+    VkIndexType indexType = vertexCount < (1u << 16) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+    uint32_t slots = getIndexSlots(indexType);
+
+    VkDeviceSize vertexOffset = 0;
+    VkDeviceSize firstSlot = 0;
+
+    if(!rangeAlloc(pool.vertexRanges, vertexCount, 1, vertexOffset))
+        return false;
+
+    if(!rangeAlloc(pool.indexRanges, (VkDeviceSize)indexCount * slots, slots, firstSlot)){
+        rangeFree(pool.vertexRanges, vertexOffset, vertexCount);
+        return false;
+    }
+
+    result.vertexOffset = (uint32_t)vertexOffset;
+    result.vertexCount = vertexCount;
+    result.firstIndex = (uint32_t)(firstSlot / slots);
+    result.indexCount = indexCount;
+    result.indexType = indexType;
+    result.lodCount = 1;
+    result.lods[0] = {0, indexCount, 0.0f};
+    return true;
+}
+
+void geometryFree(GeometryPool& pool, const Mesh& mesh){
+    uint32_t slots = getIndexSlots(mesh.indexType);
+    rangeFree(pool.vertexRanges, mesh.vertexOffset, mesh.vertexCount);
+    rangeFree(pool.indexRanges, (VkDeviceSize)mesh.firstIndex * slots, (VkDeviceSize)mesh.indexCount * slots);
+}
+
+bool uploadMesh(GeometryPool& pool, Uploader& uploader, const void* vertices, uint32_t vertexCount,
+    const uint32_t* indices, uint32_t indexCount, Mesh& result, const MeshLod* lods, uint32_t lodCount){
+    if(!geometryAlloc(pool, vertexCount, indexCount, result))
+        return false;
+
+    if(lodCount > 0){
+        assert(lodCount <= MESH_LOD_MAX);
+        result.lodCount = lodCount;
+        memcpy(result.lods, lods, lodCount * sizeof(MeshLod));
+    }
+
+    uploadBuffer(uploader, pool.vertices, (VkDeviceSize)result.vertexOffset * pool.vertexStride,
+        vertices, (size_t)vertexCount * pool.vertexStride);
+
+    if(result.indexType == VK_INDEX_TYPE_UINT32){
+        uploadBuffer(uploader, pool.indices, (VkDeviceSize)result.firstIndex * sizeof(uint32_t),
+            indices, (size_t)indexCount * sizeof(uint32_t));
+        return true;
+    }
+
+    // the uploader copies out right away, so the narrowed indices only live here
+    Scratch scratch;
+    uint16_t* narrow = (uint16_t*)alloc(scratch.allocator(), (size_t)indexCount * sizeof(uint16_t), alignof(uint16_t));
+    for(uint32_t i=0;i<indexCount;i++)
+        narrow[i] = (uint16_t)indices[i];
+
+    uploadBuffer(uploader, pool.indices, (VkDeviceSize)result.firstIndex * sizeof(uint16_t),
+        narrow, (size_t)indexCount * sizeof(uint16_t));
+    return true;
+}
+
+uint32_t selectMeshLod(const Mesh& mesh, uint32_t currentLod, float pixelsPerUnit, float pixelError){
+    uint32_t lod = glm::min(currentLod, mesh.lodCount - 1);
+
+    // errors only grow with the level, so walk from the current one
+    while(lod > 0 && mesh.lods[lod].error * pixelsPerUnit > pixelError * (1.0f + LOD_HYSTERESIS))
+        lod--;
+    while(lod + 1 < mesh.lodCount && mesh.lods[lod + 1].error * pixelsPerUnit <= pixelError * (1.0f - LOD_HYSTERESIS))
+        lod++;
+
+    return lod;
+}
+
+static Vertex objVertex(const fastObjMesh* obj, fastObjIndex index){
+    glm::vec3 pos = {obj->positions[3*index.p+0], obj->positions[3*index.p+1], obj->positions[3*index.p+2]};
+    glm::vec3 color = {1.0f,1.0f,0.0f};
+    glm::vec2 texCoord = {0.0f,0.0f};
+
+    if(index.t != 0)
+        texCoord = {obj->texcoords[2*index.t+0], obj->texcoords[2*index.t+1]};
+
+    return {pos,color,texCoord};
+}
+
+// Runs fn(i) for i in [0, count), one thread each with i = 0 on the caller
+template <typename F>
+static void parallelFor(uint32_t count, F fn){
+    std::thread threads[MESH_IMPORT_MAX_THREADS];
+    for(uint32_t i=1;i<count;i++)
+        threads[i] = std::thread(fn, i);
+
+    fn(0);
+
+    for(uint32_t i=1;i<count;i++)
+        threads[i].join();
+}
+
+struct ImportChunk{
+    uint32_t firstFace;
+    uint32_t faceEnd;
+    size_t firstCorner; // into obj->indices
+    size_t firstIndex; // into the output indices
+
+    // lives until the import finished, the thread that filled it is gone by then
+    Allocator arena;
+    Vertex* vertices; // unique within the chunk
+    uint64_t* hashes;
+    uint32_t* remap; // chunk vertex to output vertex
+    uint32_t vertexCount;
+
+    // partition of the merge run by the thread with this chunk's index
+    Vector<Vertex>* partition;
+};
+
+static uint32_t partitionOf(uint64_t hash, uint32_t partitionCount){
+    // the low bits pick table slots and the top bits are tags, keep clear of both
+    return (uint32_t)((hash >> 24) & 0xffffffff) % partitionCount;
+}
+
+bool loadModel(Vector<Vertex>& vertices, Vector<uint32_t>& indices, const char* path){
+    fastObjMesh* obj = fast_obj_read(path);
+    if(!obj){
+        printf("failed to load\n");
+        return false;
+    }
+
+    // every triangle corner becomes one index
+    size_t indexCount = 0;
+    for(unsigned int i=0;i<obj->face_count; i++){
+        indexCount += 3*(obj->face_vertices[i]-2);
+    }
+
+    // nothing to triangulate, the streams stay as they are
+    if(indexCount == 0){
+        fast_obj_destroy(obj);
+        return true;
+    }
+
+    uint32_t threadCount = std::thread::hardware_concurrency();
+    threadCount = threadCount < MESH_IMPORT_MAX_THREADS ? threadCount : MESH_IMPORT_MAX_THREADS;
+    uint32_t chunkCount = (uint32_t)(indexCount / 3 / MESH_IMPORT_CHUNK_MIN);
+    chunkCount = chunkCount < threadCount ? chunkCount : threadCount;
+    chunkCount = chunkCount > 0 ? chunkCount : 1;
+
+    // cut the faces into chunks of about the same number of triangles
+    ImportChunk chunks[MESH_IMPORT_MAX_THREADS] = {};
+    {
+        size_t corner = 0;
+        size_t index = 0;
+        uint32_t chunk = 0;
+        chunks[0] = {0, 0, 0, 0};
+
+        for(unsigned int i=0;i<obj->face_count; i++){
+            if(chunk + 1 < chunkCount && index >= indexCount * (chunk + 1) / chunkCount){
+                chunks[chunk].faceEnd = i;
+                chunk++;
+                chunks[chunk] = {i, 0, corner, index};
+            }
+            corner += obj->face_vertices[i];
+            index += 3*(obj->face_vertices[i]-2);
+        }
+        chunks[chunk].faceEnd = obj->face_count;
+        chunkCount = chunk + 1;
+    }
+
+    // every thread writes its own range of the indices
+    size_t indexBase = indices.size;
+    indices.resize(indexBase + indexCount);
+    uint32_t* output = indices.data + indexBase;
+
+    // triangulate and dedup each chunk on its own, output holds chunk vertex
+    // numbers until the remap
+    parallelFor(chunkCount, [&](uint32_t c){
+        ImportChunk& chunk = chunks[c];
+        chunk.arena = arenaNew(ARENA_DEFAULT_RESERVE, Arena_Growable);
+
+        size_t cornerCount = (c + 1 < chunkCount ? chunks[c+1].firstIndex : indexCount) - chunk.firstIndex;
+        chunk.vertices = (Vertex*)alloc(chunk.arena, cornerCount * sizeof(Vertex), alignof(Vertex));
+        chunk.hashes = (uint64_t*)alloc(chunk.arena, cornerCount * sizeof(uint64_t), alignof(uint64_t));
+
+        // closed meshes share each vertex between about six triangles so a
+        // quarter of the corners is plenty
+        HashMap<Vertex, uint32_t> uniqueVertices(chunk.arena, cornerCount/4);
+
+        size_t indexOffset = chunk.firstCorner;
+        uint32_t* out = output + chunk.firstIndex;
+
+        for(uint32_t i=chunk.firstFace;i<chunk.faceEnd; i++){
+            for(unsigned int j=0;j<obj->face_vertices[i]-2;j++){
+                fastObjIndex triIdx[3] = {obj->indices[indexOffset], obj->indices[indexOffset+j+1], obj->indices[indexOffset+j+2]};
+
+                for(unsigned k=0;k<3;k++){
+                    Vertex vert = objVertex(obj, triIdx[k]);
+
+                    bool inserted = false;
+                    uint32_t idx = uniqueVertices.findOrInsert(vert, chunk.vertexCount, &inserted);
+                    if(inserted){
+                        chunk.vertices[chunk.vertexCount] = vert;
+                        chunk.hashes[chunk.vertexCount] = BytesHash<Vertex>{}(vert);
+                        chunk.vertexCount++;
+                    }
+
+                    *out++ = idx;
+                }
+            }
+            indexOffset += obj->face_vertices[i];
+        }
+
+        chunk.remap = (uint32_t*)alloc(chunk.arena, chunk.vertexCount * sizeof(uint32_t), alignof(uint32_t));
+    });
+
+    // vertices shared between chunks meet in the same partition, each thread
+    // dedups one partition of every chunk. remap holds partition local numbers
+    parallelFor(chunkCount, [&](uint32_t p){
+        Allocator& arena = chunks[p].arena;
+
+        size_t estimate = 0;
+        for(uint32_t c=0;c<chunkCount;c++)
+            estimate += chunks[c].vertexCount;
+        estimate /= chunkCount;
+
+        HashMap<Vertex, uint32_t> uniqueVertices(arena, estimate);
+        Vector<Vertex>* partition = (Vector<Vertex>*)alloc(arena, sizeof(Vector<Vertex>), alignof(Vector<Vertex>));
+        new (partition) Vector<Vertex>(arena, estimate);
+
+        for(uint32_t c=0;c<chunkCount;c++){
+            const ImportChunk& chunk = chunks[c];
+            for(uint32_t v=0;v<chunk.vertexCount;v++){
+                if(partitionOf(chunk.hashes[v], chunkCount) != p) continue;
+
+                bool inserted = false;
+                uint32_t idx = uniqueVertices.findOrInsert(chunk.vertices[v], (uint32_t)partition->size, &inserted);
+                if(inserted)
+                    partition->push(chunk.vertices[v]);
+
+                // each vertex belongs to one partition so the threads never
+                // write the same entry
+                chunk.remap[v] = idx;
+            }
+        }
+
+        chunks[p].partition = partition;
+    });
+
+    size_t vertexBase = vertices.size;
+    uint32_t partitionBase[MESH_IMPORT_MAX_THREADS];
+    size_t vertexCount = 0;
+    for(uint32_t p=0;p<chunkCount;p++){
+        partitionBase[p] = (uint32_t)(vertexBase + vertexCount);
+        vertexCount += chunks[p].partition->size;
+    }
+    vertices.resize(vertexBase + vertexCount);
+
+    // place the partitions and rewrite every chunk's indices to output vertices
+    parallelFor(chunkCount, [&](uint32_t c){
+        ImportChunk& chunk = chunks[c];
+
+        const Vector<Vertex>& partition = *chunk.partition;
+        memcpy(vertices.data + partitionBase[c], partition.data, partition.size * sizeof(Vertex));
+
+        for(uint32_t v=0;v<chunk.vertexCount;v++)
+            chunk.remap[v] += partitionBase[partitionOf(chunk.hashes[v], chunkCount)];
+
+        size_t end = c + 1 < chunkCount ? chunks[c+1].firstIndex : indexCount;
+        for(size_t i=chunk.firstIndex;i<end;i++)
+            output[i] = chunk.remap[output[i]];
+    });
+
+    for(uint32_t c=0;c<chunkCount;c++)
+        arenaFree(chunks[c].arena);
+
+    fast_obj_destroy(obj);
+
+    return true;
+}
+
+// Cache files sit next to their source
+static char* getCachePath(Allocator& allocator, const char* sourcePath){
+    size_t length = strlen(sourcePath);
+    char* path = (char*)alloc(allocator, length + sizeof(MESH_CACHE_EXTENSION), 1);
+    memcpy(path, sourcePath, length);
+    memcpy(path + length, MESH_CACHE_EXTENSION, sizeof(MESH_CACHE_EXTENSION));
+    return path;
+}
+
+bool openMeshCache(MeshCache& result, const char* sourcePath, uint32_t importFlags){
+    result = {};
+
+    Scratch scratch;
+    MappedFile file = osMapFile(getCachePath(scratch.allocator(), sourcePath), OsAlloc_WillNeed);
+    if(!file.memory) return false;
+
+    const MeshCacheHeader* header = (const MeshCacheHeader*)file.memory;
+    bool valid = file.size >= sizeof(MeshCacheHeader) &&
+        header->magic == MESH_CACHE_MAGIC && header->version == MESH_CACHE_VERSION &&
+        header->vertexStride == sizeof(Vertex) && header->importFlags == importFlags &&
+        header->lodCount >= 1 && header->lodCount <= MESH_LOD_MAX &&
+        header->pathHash == hashBytes(sourcePath, strlen(sourcePath)) &&
+        ((header->importFlags & MeshImport_Compress) ||
+            (header->vertexBytes == (uint64_t)header->vertexCount * sizeof(Vertex) &&
+            header->indexBytes == (uint64_t)header->indexCount * sizeof(uint32_t))) &&
+        header->vertexOffset + header->vertexBytes <= file.size &&
+        header->indexOffset + header->indexBytes <= file.size &&
+        header->meshletOffset + (uint64_t)header->meshletCount * sizeof(Meshlet) <= file.size &&
+        header->meshletBoundsOffset + (uint64_t)header->meshletCount * sizeof(MeshletBounds) <= file.size &&
+        header->meshletVertexOffset + (uint64_t)header->meshletVertexCount * sizeof(uint32_t) <= file.size &&
+        header->meshletTriangleOffset + header->meshletTriangleBytes <= file.size;
+
+    for(uint32_t i=0;valid && i<header->lodCount;i++)
+        valid = (uint64_t)header->lods[i].firstIndex + header->lods[i].indexCount <= header->indexCount;
+
+    if(valid){
+        // only a changed time needs the source read, touching a file keeps its cache
+        MappedFile source = osMapFile(sourcePath);
+        valid = source.memory && source.size == header->sourceSize &&
+            (source.modified == header->sourceModified || hashBytes(source.memory, source.size) == header->sourceHash);
+        osUnmapFile(source);
+    }
+
+    // catches truncated and partially written caches
+    valid = valid && hashBytes((const uint8_t*)file.memory + sizeof(MeshCacheHeader), file.size - sizeof(MeshCacheHeader)) == header->checksum;
+
+    if(!valid){
+        osUnmapFile(file);
+        return false;
+    }
+
+    result.file = file;
+    result.header = *header;
+    result.vertices = (const Vertex*)((const uint8_t*)file.memory + header->vertexOffset);
+    result.indices = (const uint32_t*)((const uint8_t*)file.memory + header->indexOffset);
+    result.meshlets = (const Meshlet*)((const uint8_t*)file.memory + header->meshletOffset);
+    result.meshletBounds = (const MeshletBounds*)((const uint8_t*)file.memory + header->meshletBoundsOffset);
+    result.meshletVertices = (const uint32_t*)((const uint8_t*)file.memory + header->meshletVertexOffset);
+    result.meshletTriangles = (const uint8_t*)file.memory + header->meshletTriangleOffset;
+
+    if(header->importFlags & MeshImport_Compress){
+        uint64_t vertexBytes = alignPow2((uint64_t)header->vertexCount * sizeof(Vertex), 16);
+        uint64_t indexBytes = (uint64_t)header->indexCount * sizeof(uint32_t);
+        result.decoded = osAlloc(vertexBytes + indexBytes);
+
+        Vertex* vertices = (Vertex*)result.decoded.memory;
+        uint32_t* indices = (uint32_t*)((uint8_t*)result.decoded.memory + vertexBytes);
+
+        // each decoder runs at 1-2 GB/s on one core, side by side the open
+        // takes as long as the slower of the two
+        bool decoded[2] = {};
+        parallelFor(2, [&](uint32_t stream){
+            if(stream == 0){
+                decoded[0] = decodeVertexBuffer(vertices, header->vertexCount, sizeof(Vertex),
+                    (const uint8_t*)file.memory + header->vertexOffset, header->vertexBytes);
+            }else{
+                decoded[1] = decodeIndexBuffer(indices, header->indexCount,
+                    (const uint8_t*)file.memory + header->indexOffset, header->indexBytes);
+            }
+        });
+        if(!decoded[0] || !decoded[1]){
+            closeMeshCache(result);
+            return false;
+        }
+        result.vertices = vertices;
+        result.indices = indices;
+    }
+    return true;
+}
+
+static void computeBounds(MeshCacheHeader& header, const Vertex* vertices, uint32_t vertexCount){
+    header.boundsMin = vertexCount ? vertices[0].pos : glm::vec3(0.0f);
+    header.boundsMax = header.boundsMin;
+    for(uint32_t i=0;i<vertexCount;i++){
+        header.boundsMin = glm::min(header.boundsMin, vertices[i].pos);
+        header.boundsMax = glm::max(header.boundsMax, vertices[i].pos);
+    }
+}
+
+bool writeMeshCache(const char* sourcePath, const MeshCache& mesh){
+    MappedFile source = osMapFile(sourcePath);
+    if(!source.memory) return false;
+
+    MeshCacheHeader header{};
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    header.pathHash = hashBytes(sourcePath, strlen(sourcePath));
+    header.sourceModified = source.modified;
+    header.sourceSize = source.size;
+    header.sourceHash = hashBytes(source.memory, source.size);
+    osUnmapFile(source);
+
+    header.vertexStride = sizeof(Vertex);
+    header.vertexCount = mesh.header.vertexCount;
+    header.indexCount = mesh.header.indexCount;
+    header.importFlags = mesh.header.importFlags;
+    header.lodCount = mesh.header.lodCount;
+    memcpy(header.lods, mesh.header.lods, sizeof(header.lods));
+    header.meshletCount = mesh.header.meshletCount;
+    header.meshletVertexCount = mesh.header.meshletVertexCount;
+    header.meshletTriangleBytes = mesh.header.meshletTriangleBytes;
+
+    Scratch scratch;
+    const void* vertexData = mesh.vertices;
+    const void* indexData = mesh.indices;
+    uint64_t vertexBytes = (uint64_t)header.vertexCount * sizeof(Vertex);
+    uint64_t indexBytes = (uint64_t)header.indexCount * sizeof(uint32_t);
+
+    if(header.importFlags & MeshImport_Compress){
+        size_t vertexBound = encodeVertexBufferBound(header.vertexCount, sizeof(Vertex));
+        size_t indexBound = encodeIndexBufferBound(header.indexCount);
+        uint8_t* encodedVertices = (uint8_t*)alloc(scratch.allocator(), vertexBound, 16);
+        uint8_t* encodedIndices = (uint8_t*)alloc(scratch.allocator(), indexBound, 16);
+        uint64_t encodedVertexBytes = encodeVertexBuffer(encodedVertices, vertexBound, mesh.vertices, header.vertexCount,
+            sizeof(Vertex));
+        uint64_t encodedIndexBytes = encodeIndexBuffer(encodedIndices, indexBound, mesh.indices, header.indexCount);
+
+        printf("Mesh cache: vertices %llu -> %llu bytes, indices %llu -> %llu bytes\n", (unsigned long long)vertexBytes,
+            (unsigned long long)encodedVertexBytes, (unsigned long long)indexBytes, (unsigned long long)encodedIndexBytes);
+
+        vertexData = encodedVertices;
+        indexData = encodedIndices;
+        vertexBytes = encodedVertexBytes;
+        indexBytes = encodedIndexBytes;
+    }
+    header.vertexBytes = vertexBytes;
+    header.indexBytes = indexBytes;
+
+    uint64_t meshletBytes = (uint64_t)header.meshletCount * sizeof(Meshlet);
+    uint64_t meshletBoundsBytes = (uint64_t)header.meshletCount * sizeof(MeshletBounds);
+    uint64_t meshletVertexBytes = (uint64_t)header.meshletVertexCount * sizeof(uint32_t);
+
+    header.vertexOffset = alignPow2(sizeof(MeshCacheHeader), 16);
+    header.indexOffset = alignPow2(header.vertexOffset + vertexBytes, 16);
+    header.meshletOffset = alignPow2(header.indexOffset + indexBytes, 16);
+    header.meshletBoundsOffset = alignPow2(header.meshletOffset + meshletBytes, 16);
+    header.meshletVertexOffset = alignPow2(header.meshletBoundsOffset + meshletBoundsBytes, 16);
+    header.meshletTriangleOffset = alignPow2(header.meshletVertexOffset + meshletVertexBytes, 16);
+
+    computeBounds(header, mesh.vertices, header.vertexCount);
+
+    // the body is built in memory so the checksum covers exactly what is written
+    uint64_t bodySize = header.meshletTriangleOffset + header.meshletTriangleBytes - sizeof(MeshCacheHeader);
+    uint8_t* body = (uint8_t*)alloc(scratch.allocator(), bodySize, 16);
+    memset(body, 0, bodySize);
+    memcpy(body - sizeof(MeshCacheHeader) + header.vertexOffset, vertexData, vertexBytes);
+    memcpy(body - sizeof(MeshCacheHeader) + header.indexOffset, indexData, indexBytes);
+    if(header.meshletCount > 0){
+        memcpy(body - sizeof(MeshCacheHeader) + header.meshletOffset, mesh.meshlets, meshletBytes);
+        memcpy(body - sizeof(MeshCacheHeader) + header.meshletBoundsOffset, mesh.meshletBounds, meshletBoundsBytes);
+        memcpy(body - sizeof(MeshCacheHeader) + header.meshletVertexOffset, mesh.meshletVertices, meshletVertexBytes);
+        memcpy(body - sizeof(MeshCacheHeader) + header.meshletTriangleOffset, mesh.meshletTriangles, header.meshletTriangleBytes);
+    }
+    header.checksum = hashBytes(body, bodySize);
+
+    FILE* file = fopen(getCachePath(scratch.allocator(), sourcePath), "wb");
+    if(!file){
+        printf("Warning: cannot write mesh cache for %s\n", sourcePath);
+        return false;
+    }
+
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(body, 1, bodySize, file) == bodySize;
+    written = fclose(file) == 0 && written;
+    return written;
+}
+
+// Import passes, their output is what gets cached. Returns the vertex count,
+// which only shrinks if some vertices were not referenced
+static uint32_t optimizeMesh(Vertex* vertices, uint32_t vertexCount, uint32_t* indices, uint32_t indexCount,
+    uint32_t importFlags){
+    VertexCacheStats before = analyzeVertexCache(indices, indexCount, vertexCount);
+    optimizeVertexCache(indices, indices, indexCount, vertexCount);
+    VertexCacheStats after = analyzeVertexCache(indices, indexCount, vertexCount);
+
+    printf("Vertex cache: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", before.acmr, after.acmr, before.atvr, after.atvr);
+
+    if(importFlags & MeshImport_Overdraw){
+        OverdrawStats overdrawBefore = analyzeOverdraw(indices, indexCount, &vertices[0].pos.x, vertexCount, sizeof(Vertex));
+        size_t clusters = optimizeOverdraw(indices, indices, indexCount, &vertices[0].pos.x, vertexCount, sizeof(Vertex));
+        OverdrawStats overdrawAfter = analyzeOverdraw(indices, indexCount, &vertices[0].pos.x, vertexCount, sizeof(Vertex));
+        VertexCacheStats cache = analyzeVertexCache(indices, indexCount, vertexCount);
+
+        printf("Overdraw: %.3f -> %.3f in %zu clusters, ACMR %.3f\n", overdrawBefore.overdraw, overdrawAfter.overdraw,
+            clusters, cache.acmr);
+    }
+
+    // last, it follows the final triangle order
+    if(importFlags & MeshImport_VertexFetch){
+        VertexFetchStats fetchBefore = analyzeVertexFetch(indices, indexCount, vertexCount, sizeof(Vertex));
+        vertexCount = (uint32_t)optimizeVertexFetch(vertices, indices, indexCount, vertices, vertexCount, sizeof(Vertex));
+        VertexFetchStats fetchAfter = analyzeVertexFetch(indices, indexCount, vertexCount, sizeof(Vertex));
+
+        printf("Vertex fetch: overfetch %.3f -> %.3f\n", fetchBefore.overfetch, fetchAfter.overfetch);
+    }
+
+    return vertexCount;
+}
+
+// Simplifies each level from the one before and appends it to indices, errors
+// add up so every level's error estimates its distance from level 0 rather
+// than the one before. Returns the level count
+static uint32_t buildLodChain(MeshLod* lods, Vector<uint32_t>& indices, uint64_t indexBase, const Vertex* vertices,
+    uint32_t vertexCount){
+    MeshCacheHeader bounds{};
+    computeBounds(bounds, vertices, vertexCount);
+    glm::vec3 extent = bounds.boundsMax - bounds.boundsMin;
+    float maxError = MESH_LOD_MAX_ERROR * glm::max(extent.x, glm::max(extent.y, extent.z));
+
+    // color and texCoord follow each other as 5 floats
+    static_assert(offsetof(Vertex, texCoord) == offsetof(Vertex, color) + sizeof(glm::vec3));
+
+    uint32_t lodCount = 1;
+    for(;lodCount<MESH_LOD_MAX;lodCount++){
+        const MeshLod& previous = lods[lodCount - 1];
+        if(previous.error >= maxError) break;
+
+        Scratch scratch;
+        uint32_t* level = (uint32_t*)alloc(scratch.allocator(), previous.indexCount * sizeof(uint32_t), alignof(uint32_t));
+        float error = 0.0f;
+        size_t indexCount = simplifyMesh(level, indices.data + indexBase + previous.firstIndex, previous.indexCount,
+            &vertices[0].pos.x, vertexCount, sizeof(Vertex), &vertices[0].color.x, sizeof(Vertex), 5,
+            MESH_LOD_ATTRIBUTE_WEIGHT, previous.indexCount / 6 * 3, maxError - previous.error, &error);
+
+        // locked borders and seams or the error limit stopped the simplifier
+        if(indexCount == 0 || indexCount > previous.indexCount / 4 * 3) break;
+
+        optimizeVertexCache(level, level, indexCount, vertexCount);
+
+        uint64_t firstIndex = indices.size - indexBase;
+        indices.resize(indices.size + indexCount);
+        memcpy(indices.data + indexBase + firstIndex, level, indexCount * sizeof(uint32_t));
+        lods[lodCount] = {(uint32_t)firstIndex, (uint32_t)indexCount, previous.error + error};
+
+        printf("LOD %u: %zu triangles, error %f\n", lodCount, indexCount / 3, lods[lodCount].error);
+    }
+
+    return lodCount;
+}
+
+// Meshlets of the final triangle order, with bounds for cluster culling
+static void buildMeshletStreams(MeshCache& mesh, Allocator& allocator){
+    uint32_t indexCount = mesh.header.lods[0].indexCount;
+    size_t bound = buildMeshletsBound(indexCount);
+    size_t triangleBytes = bound * alignPow2(MESHLET_MAX_TRIANGLES * 3, 4);
+
+    Meshlet* meshlets = (Meshlet*)alloc(allocator, bound * sizeof(Meshlet), alignof(Meshlet));
+    uint32_t* meshletVertices = (uint32_t*)alloc(allocator, indexCount * sizeof(uint32_t), alignof(uint32_t));
+    uint8_t* meshletTriangles = (uint8_t*)alloc(allocator, triangleBytes, 4);
+    uint32_t meshletCount = (uint32_t)buildMeshlets(meshlets, meshletVertices, meshletTriangles, mesh.indices, indexCount,
+        mesh.header.vertexCount);
+
+    MeshletBounds* bounds = (MeshletBounds*)alloc(allocator, meshletCount * sizeof(MeshletBounds), alignof(MeshletBounds));
+    uint32_t cones = 0;
+    for(uint32_t i=0;i<meshletCount;i++){
+        bounds[i] = computeMeshletBounds(meshlets[i], meshletVertices, meshletTriangles, &mesh.vertices[0].pos.x, sizeof(Vertex));
+        cones += bounds[i].coneCutoff < 1.0f;
+    }
+
+    mesh.header.meshletCount = meshletCount;
+    if(meshletCount > 0){
+        const Meshlet& last = meshlets[meshletCount - 1];
+        mesh.header.meshletVertexCount = last.vertexOffset + last.vertexCount;
+        mesh.header.meshletTriangleBytes = last.triangleOffset + (uint32_t)alignPow2(last.triangleCount * 3, 4);
+
+        printf("Meshlets: %u, %.1f vertices and %.1f triangles each, %u with a normal cone\n", meshletCount,
+            (float)mesh.header.meshletVertexCount / meshletCount, (float)indexCount / 3 / meshletCount, cones);
+    }
+
+    mesh.meshlets = meshlets;
+    mesh.meshletBounds = bounds;
+    mesh.meshletVertices = meshletVertices;
+    mesh.meshletTriangles = meshletTriangles;
+}
+
+bool loadMesh(MeshCache& result, Vector<Vertex>& vertices, Vector<uint32_t>& indices, const char* path,
+    uint32_t importFlags){
+    if(openMeshCache(result, path, importFlags))
+        return true;
+
+    uint64_t vertexBase = vertices.size;
+    uint64_t indexBase = indices.size;
+    if(!loadModel(vertices, indices, path))
+        return false;
+
+    uint32_t vertexCount = (uint32_t)(vertices.size - vertexBase);
+    uint32_t indexCount = (uint32_t)(indices.size - indexBase);
+
+    // the import passes and the cache all expect triangles
+    if(indexCount == 0){
+        result = {};
+        result.header.lodCount = 1;
+        result.header.importFlags = importFlags;
+        return true;
+    }
+
+    vertexCount = optimizeMesh(vertices.data + vertexBase, vertexCount, indices.data + indexBase, indexCount, importFlags);
+    vertices.size = vertexBase + vertexCount;
+
+    MeshCache imported{};
+    imported.header.vertexStride = sizeof(Vertex);
+    imported.header.vertexCount = vertexCount;
+    imported.header.indexCount = indexCount;
+    imported.header.importFlags = importFlags;
+    imported.vertices = vertices.data + vertexBase;
+    imported.indices = indices.data + indexBase;
+    imported.header.lodCount = 1;
+    imported.header.lods[0] = {0, indexCount, 0.0f};
+    if(importFlags & MeshImport_Lods){
+        imported.header.lodCount = buildLodChain(imported.header.lods, indices, indexBase, imported.vertices, vertexCount);
+        imported.header.indexCount = (uint32_t)(indices.size - indexBase);
+        imported.indices = indices.data + indexBase;
+    }
+    if(importFlags & MeshImport_Meshlets)
+        buildMeshletStreams(imported, *vertices.allocator);
+
+    if(writeMeshCache(path, imported) && openMeshCache(result, path, importFlags))
+        return true;
+
+    // no cache, hand out the imported streams
+    result = imported;
+    computeBounds(result.header, result.vertices, vertexCount);
+    return true;
+}
+
+void closeMeshCache(MeshCache& cache){
+    if(cache.file.memory)
+        osUnmapFile(cache.file);
+    if(cache.decoded.memory)
+        osFree(cache.decoded.memory, cache.decoded.size);
+    cache = {};
+}
+
+// Folds the lower hemisphere over the diagonals of the upper one, n is unit length
+static glm::vec2 octEncode(glm::vec3 n){
+    n /= glm::abs(n.x) + glm::abs(n.y) + glm::abs(n.z);
+    glm::vec2 e(n.x, n.y);
+    if(n.z < 0.0f){
+        glm::vec2 sign(e.x >= 0.0f ? 1.0f : -1.0f, e.y >= 0.0f ? 1.0f : -1.0f);
+        e = (1.0f - glm::abs(glm::vec2(e.y, e.x))) * sign;
+    }
+    return e;
+}
+
+static glm::vec3 getQuantizeScale(glm::vec3 boundsMin, glm::vec3 boundsMax){
+    glm::vec3 extent = boundsMax - boundsMin;
+    return glm::vec3(extent.x > 0.0f ? 65535.0f / extent.x : 0.0f, extent.y > 0.0f ? 65535.0f / extent.y : 0.0f,
+        extent.z > 0.0f ? 65535.0f / extent.z : 0.0f);
+}
+
+void packVertices(PackedVertex* destination, const Vertex* vertices, uint32_t vertexCount,
+    const uint32_t* indices, uint32_t indexCount, glm::vec3 boundsMin, glm::vec3 boundsMax){
+    Scratch scratch;
+    glm::vec3* normals = (glm::vec3*)alloc(scratch.allocator(), vertexCount * sizeof(glm::vec3), alignof(glm::vec3));
+    memset(normals, 0, vertexCount * sizeof(glm::vec3));
+
+    // the cross product is already weighted by area
+    for(uint32_t i=0;i+2<indexCount;i+=3){
+        uint32_t a = indices[i], b = indices[i+1], c = indices[i+2];
+        glm::vec3 n = glm::cross(vertices[b].pos - vertices[a].pos, vertices[c].pos - vertices[a].pos);
+        normals[a] += n;
+        normals[b] += n;
+        normals[c] += n;
+    }
+
+    glm::vec3 scale = getQuantizeScale(boundsMin, boundsMax);
+    for(uint32_t i=0;i<vertexCount;i++){
+        const Vertex& v = vertices[i];
+        PackedVertex& p = destination[i];
+
+        glm::vec3 q = glm::clamp((v.pos - boundsMin) * scale + 0.5f, 0.0f, 65535.0f);
+        p.pos[0] = (uint16_t)q.x;
+        p.pos[1] = (uint16_t)q.y;
+        p.pos[2] = (uint16_t)q.z;
+
+        float length = glm::length(normals[i]);
+        glm::vec3 n = length > 0.0f ? normals[i] / length : glm::vec3(0.0f, 0.0f, 1.0f);
+        p.pos[3] = glm::packSnorm2x8(octEncode(n));
+
+        uint32_t color = glm::packUnorm4x8(glm::vec4(v.color, 1.0f));
+        memcpy(p.color, &color, sizeof(color));
+
+        p.texCoord[0] = glm::packHalf1x16(v.texCoord.x);
+        p.texCoord[1] = glm::packHalf1x16(v.texCoord.y);
+    }
+}
+
+VertexDecode getVertexDecode(glm::vec3 boundsMin, glm::vec3 boundsMax){
+    glm::vec3 scale = getQuantizeScale(boundsMin, boundsMax);
+
+    VertexDecode result;
+    result.boundsMin = glm::vec4(boundsMin, 0.0f);
+    result.scale = glm::vec4(scale.x > 0.0f ? 1.0f / scale.x : 0.0f, scale.y > 0.0f ? 1.0f / scale.y : 0.0f,
+        scale.z > 0.0f ? 1.0f / scale.z : 0.0f, 0.0f);
+    return result;
+}
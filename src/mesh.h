@@ -0,0 +1,206 @@
+#pragma once
+#include "common.h"
+#include "memory.h"
+#include "upload.h"
+#include "program.h"
+#include "meshopt.h"
+#include "codec.h"
+
+// Triangles per import chunk below which threads cost more than they save
+#define MESH_IMPORT_CHUNK_MIN (1u << 16)
+#define MESH_IMPORT_MAX_THREADS 32
+
+#define MESH_CACHE_MAGIC 0x4843534d // "MSCH"
+// Bumped whenever the layout or the import changes what ends up in a cache
+#define MESH_CACHE_VERSION 6
+#define MESH_CACHE_EXTENSION ".meshcache"
+
+// Vertices and 16 bit index slots the geometry pool holds for the whole scene
+#define GEOMETRY_VERTEX_CAPACITY (1u << 22)
+#define GEOMETRY_INDEX_CAPACITY (1u << 25)
+
+// Levels of detail a mesh keeps, each about half the triangles of the one before
+#define MESH_LOD_MAX 8
+// Error of the coarsest level relative to the mesh extent, the chain ends early
+// rather than distort the shape further
+#define MESH_LOD_MAX_ERROR 0.05f
+// Cost of a change in color or texture coordinates against the mesh extent
+#define MESH_LOD_ATTRIBUTE_WEIGHT 0.05f
+
+// Pixels of geometric error a level may show on screen, and by how much the
+// current level may pass that before it changes so meshes near a switch
+// distance do not flicker between two levels
+#define LOD_PIXEL_ERROR 1.0f
+#define LOD_HYSTERESIS 0.25f
+
+// A level's range of the mesh's indices, all levels use the same vertices.
+// error estimates the distance from the full mesh in mesh units, it is the
+// RMS plane distance of the simplifier's quadrics and not a bound, single
+// vertices can be further off
+struct MeshLod{
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float error;
+};
+
+// A mesh inside the geometry pool, its indices are relative to vertexOffset
+// so level i draws with vkCmdDrawIndexed(lods[i].indexCount, 1,
+// firstIndex + lods[i].firstIndex, vertexOffset) with the pool's index buffer
+// bound at offset 0 as indexType. Meshes with fewer than 65536 vertices use
+// 16 bit indices, firstIndex counts indices of that type
+struct Mesh{
+    uint32_t vertexOffset;
+    uint32_t vertexCount;
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    VkIndexType indexType;
+
+    uint32_t lodCount;
+    MeshLod lods[MESH_LOD_MAX];
+};
+
+// One vertex and one index buffer shared by every mesh, bound once for the
+// whole scene. Ranges are counted in vertices and 16 bit index slots, a 32
+// bit index takes two aligned slots
+struct GeometryPool{
+    Buffer vertices;
+    Buffer indices;
+    RangeAllocator vertexRanges;
+    RangeAllocator indexRanges;
+    uint32_t vertexStride;
+
+    // 0 unless the device allocator has buffer device address enabled
+    VkDeviceAddress vertexAddress;
+    VkDeviceAddress indexAddress;
+
+    GeometryPool(Allocator& allocator, uint32_t vertexCapacity = GEOMETRY_VERTEX_CAPACITY,
+        uint32_t indexCapacity = GEOMETRY_INDEX_CAPACITY):
+        vertexRanges(allocator, vertexCapacity), indexRanges(allocator, indexCapacity),
+        vertexStride(0), vertexAddress(0), indexAddress(0){}
+};
+
+void createGeometryPool(GeometryPool& pool, DeviceAllocator& allocator, uint32_t vertexStride);
+
+void destroyGeometryPool(GeometryPool& pool, DeviceAllocator& allocator);
+
+// Reserves room for a mesh and picks its index type, false when either buffer is full
+bool geometryAlloc(GeometryPool& pool, uint32_t vertexCount, uint32_t indexCount, Mesh& result);
+
+void geometryFree(GeometryPool& pool, const Mesh& mesh);
+
+// Reserves room and queues the upload of both streams, indices are narrowed
+// to the mesh's index type on the way. Without lods the indices are a single level
+bool uploadMesh(GeometryPool& pool, Uploader& uploader, const void* vertices, uint32_t vertexCount,
+    const uint32_t* indices, uint32_t indexCount, Mesh& result, const MeshLod* lods = nullptr, uint32_t lodCount = 0);
+
+// Picks the coarsest level whose estimated error covers at most pixelError
+// pixels with hysteresis around the current level, parts of a level can still
+// be off by more. pixelsPerUnit is how many pixels one unit of mesh space
+// covers at the mesh, viewportHeight / (2 tan(fovY / 2) distance) under a
+// perspective projection
+uint32_t selectMeshLod(const Mesh& mesh, uint32_t currentLod, float pixelsPerUnit, float pixelError = LOD_PIXEL_ERROR);
+
+// Triangulates and dedups an OBJ file into vertices and indices. Chunks of
+// faces are deduped on their own threads and merged by hash partition
+bool loadModel(Vector<Vertex>& vertices, Vector<uint32_t>& indices, const char* path);
+
+// Optional import passes, they run after the vertex cache optimization
+enum MeshImportFlags : uint32_t {
+    // Clusters triangles and draws the outward facing clusters first
+    MeshImport_Overdraw = 1 << 0,
+    // Stores vertices in the order the triangles use them
+    MeshImport_VertexFetch = 1 << 1,
+    // Splits the final triangle order into meshlets with culling bounds
+    MeshImport_Meshlets = 1 << 2,
+    // Appends simplified levels of detail to the indices
+    MeshImport_Lods = 1 << 3,
+    // Stores vertices and indices with the codecs of codec.h, they are decoded
+    // when the cache is opened instead of used from the mapping
+    MeshImport_Compress = 1 << 4,
+
+    MeshImport_Default = MeshImport_Overdraw | MeshImport_VertexFetch | MeshImport_Meshlets | MeshImport_Lods |
+        MeshImport_Compress,
+};
+
+// Start of a cache file, the streams follow at 16 byte aligned offsets
+struct MeshCacheHeader{
+    uint32_t magic;
+    uint32_t version;
+    // the source the cache was built from
+    uint64_t pathHash;
+    uint64_t sourceModified;
+    uint64_t sourceSize;
+    uint64_t sourceHash;
+
+    uint32_t vertexStride;
+    uint32_t vertexCount;
+    uint32_t indexCount; // of every level
+    uint32_t importFlags; // a cache only serves the passes it was built with
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    // stored sizes, smaller than the streams with MeshImport_Compress
+    uint64_t vertexBytes;
+    uint64_t indexBytes;
+
+    // level 0 is the full mesh, the only one without MeshImport_Lods
+    uint32_t lodCount;
+    MeshLod lods[MESH_LOD_MAX];
+
+    // of level 0, none without MeshImport_Meshlets
+    uint32_t meshletCount;
+    uint32_t meshletVertexCount;
+    uint32_t meshletTriangleBytes;
+    uint32_t meshletReserved;
+    uint64_t meshletOffset;
+    uint64_t meshletBoundsOffset;
+    uint64_t meshletVertexOffset;
+    uint64_t meshletTriangleOffset;
+
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+
+    // of every byte after the header
+    uint64_t checksum;
+};
+
+// Mesh streams ready for upload, they point into the mapped cache file, into
+// decoded, which holds vertices and indices of compressed caches, or into the
+// vectors they were imported to when no cache could be written
+struct MeshCache{
+    MappedFile file;
+    VirtualMemoryBlock decoded;
+    MeshCacheHeader header;
+    const Vertex* vertices;
+    const uint32_t* indices;
+
+    // meshlet vertices index vertices, see buildMeshlets
+    const Meshlet* meshlets;
+    const MeshletBounds* meshletBounds;
+    const uint32_t* meshletVertices;
+    const uint8_t* meshletTriangles;
+};
+
+// Maps the cache of an OBJ file, false when it is missing, corrupt or older
+// than the source. A changed source time alone is checked against the hash
+// of its contents. Compressed vertices and indices are decoded right away
+bool openMeshCache(MeshCache& result, const char* sourcePath, uint32_t importFlags = MeshImport_Default);
+
+// Writes the streams of mesh and the counts and import flags of its header
+bool writeMeshCache(const char* sourcePath, const MeshCache& mesh);
+
+// Opens the cache of path, importing and optimizing the OBJ into vertices and
+// indices and writing the cache when there is no valid one. importFlags is a
+// mask of MeshImportFlags, meshlets are allocated next to the vectors
+bool loadMesh(MeshCache& result, Vector<Vertex>& vertices, Vector<uint32_t>& indices, const char* path,
+    uint32_t importFlags = MeshImport_Default);
+
+void closeMeshCache(MeshCache& cache);
+
+// Quantizes vertices into the packed layout against the mesh bounds. Normals
+// are the area weighted normals of the triangles around each vertex, Vertex
+// has none of its own
+void packVertices(PackedVertex* destination, const Vertex* vertices, uint32_t vertexCount,
+    const uint32_t* indices, uint32_t indexCount, glm::vec3 boundsMin, glm::vec3 boundsMax);
+
+// Push constants that decode vertices packed against these bounds
+VertexDecode getVertexDecode(glm::vec3 boundsMin, glm::vec3 boundsMax);
@@ -0,0 +1,800 @@
+#include <glm/geometric.hpp>
+
+#include "meshopt.h"
+
+VertexCacheStats analyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize){
+    Scratch scratch;
+
+    // a vertex is cached while fewer than cacheSize misses happened since its
+    // own miss, which is exactly a FIFO of cacheSize entries
+    uint32_t* missTime = (uint32_t*)alloc(scratch.allocator(), vertexCount * sizeof(uint32_t), alignof(uint32_t));
+    memset(missTime, 0, vertexCount * sizeof(uint32_t));
+
+    uint32_t time = cacheSize + 1;
+    uint32_t referenced = 0;
+
+    VertexCacheStats result{};
+    for(size_t i=0;i<indexCount;i++){
+        uint32_t v = indices[i];
+        if(missTime[v] == 0) referenced++;
+
+        if(time - missTime[v] > cacheSize){
+            missTime[v] = time++;
+            result.transformed++;
+        }
+    }
+
+    result.acmr = indexCount ? (float)result.transformed / (indexCount / 3) : 0.0f;
+    result.atvr = referenced ? (float)result.transformed / referenced : 0.0f;
+    return result;
+}
+
+// Next fanning vertex: a candidate that stays in the cache after its remaining
+// triangles are emitted, the oldest one first
+static int64_t getNextVertex(const uint32_t* candidates, uint32_t candidateCount, const uint32_t* liveTriangles,
+    const uint32_t* cacheTime, uint32_t time, uint32_t cacheSize,
+    uint32_t* deadEnd, uint32_t& deadEndCount, size_t& cursor, size_t vertexCount){
+    int64_t best = -1;
+    uint32_t bestPriority = 0;
+
+    for(uint32_t i=0;i<candidateCount;i++){
+        uint32_t v = candidates[i];
+        if(liveTriangles[v] == 0) continue;
+
+        uint32_t priority = 0;
+        if(time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+            priority = time - cacheTime[v];
+
+        if(best < 0 || priority > bestPriority){
+            best = v;
+            bestPriority = priority;
+        }
+    }
+    if(best >= 0) return best;
+
+    // recently used vertices that still have triangles
+    while(deadEndCount > 0){
+        uint32_t v = deadEnd[--deadEndCount];
+        if(liveTriangles[v] > 0) return v;
+    }
+
+    // anything left, in input order
+    for(; cursor < vertexCount; cursor++){
+        if(liveTriangles[cursor] > 0) return (int64_t)cursor;
+    }
+
+    return -1;
+}
+
+void optimizeVertexCache(uint32_t* destination, const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize){
+    assert(indexCount % 3 == 0);
+    size_t triangleCount = indexCount / 3;
+    if(triangleCount == 0) return;
+
+    Scratch scratch;
+    Allocator& allocator = scratch.allocator();
+
+    // keep the input when writing over it
+    if(destination == indices){
+        uint32_t* copy = (uint32_t*)alloc(allocator, indexCount * sizeof(uint32_t), alignof(uint32_t));
+        memcpy(copy, indices, indexCount * sizeof(uint32_t));
+        indices = copy;
+    }
+
+    // triangles around each vertex
+    uint32_t* liveTriangles = (uint32_t*)alloc(allocator, vertexCount * sizeof(uint32_t), alignof(uint32_t));
+    uint32_t* adjacencyOffset = (uint32_t*)alloc(allocator, (vertexCount + 1) * sizeof(uint32_t), alignof(uint32_t));
+    uint32_t* adjacency = (uint32_t*)alloc(allocator, indexCount * sizeof(uint32_t), alignof(uint32_t));
+    memset(liveTriangles, 0, vertexCount * sizeof(uint32_t));
+
+    for(size_t i=0;i<indexCount;i++)
+        liveTriangles[indices[i]]++;
+
+    adjacencyOffset[0] = 0;
+    for(size_t v=0;v<vertexCount;v++)
+        adjacencyOffset[v+1] = adjacencyOffset[v] + liveTriangles[v];
+
+    // filled by counting back down from each vertex's end
+    uint32_t* fill = (uint32_t*)alloc(allocator, vertexCount * sizeof(uint32_t), alignof(uint32_t));
+    memcpy(fill, adjacencyOffset + 1, vertexCount * sizeof(uint32_t));
+    for(size_t t=triangleCount;t-- > 0;){
+        for(uint32_t k=0;k<3;k++)
+            adjacency[--fill[indices[3*t+k]]] = (uint32_t)t;
+    }
+
+    uint32_t* cacheTime = (uint32_t*)alloc(allocator, vertexCount * sizeof(uint32_t), alignof(uint32_t));
+    memset(cacheTime, 0, vertexCount * sizeof(uint32_t));
+    uint8_t* emitted = (uint8_t*)alloc(allocator, triangleCount, 1);
+    memset(emitted, 0, triangleCount);
+
+    // every emitted corner is pushed once, so the stack never holds more
+    uint32_t* deadEnd = (uint32_t*)alloc(allocator, indexCount * sizeof(uint32_t), alignof(uint32_t));
+    uint32_t deadEndCount = 0;
+
+    // the fanning vertex's triangles cannot share more than 2 corners with it
+    uint32_t* candidates = nullptr;
+    uint32_t candidateCapacity = 0;
+
+    uint32_t time = cacheSize + 1;
+    size_t cursor = 1;
+    size_t written = 0;
+    int64_t fanning = 0;
+
+    while(fanning >= 0){
+        uint32_t f = (uint32_t)fanning;
+        uint32_t begin = adjacencyOffset[f];
+        uint32_t end = adjacencyOffset[f+1];
+
+        if(3 * (end - begin) > candidateCapacity){
+            candidateCapacity = 3 * (end - begin);
+            candidates = (uint32_t*)alloc(allocator, candidateCapacity * sizeof(uint32_t), alignof(uint32_t));
+        }
+        uint32_t candidateCount = 0;
+
+        for(uint32_t a=begin;a<end;a++){
+            uint32_t t = adjacency[a];
+            if(emitted[t]) continue;
+            emitted[t] = 1;
+
+            for(uint32_t k=0;k<3;k++){
+                uint32_t v = indices[3*t+k];
+                destination[written++] = v;
+
+                deadEnd[deadEndCount++] = v;
+                candidates[candidateCount++] = v;
+                liveTriangles[v]--;
+
+                if(time - cacheTime[v] > cacheSize)
+                    cacheTime[v] = time++;
+            }
+        }
+
+        fanning = getNextVertex(candidates, candidateCount, liveTriangles, cacheTime, time, cacheSize,
+            deadEnd, deadEndCount, cursor, vertexCount);
+    }
+
+    assert(written == indexCount);
+}
+
+VertexFetchStats analyzeVertexFetch(const uint32_t* indices, size_t indexCount, size_t vertexCount, size_t vertexSize){
+    Scratch scratch;
+    Allocator& allocator = scratch.allocator();
+
+    // only post transform cache misses reach memory, both caches are FIFOs
+    // tracked by miss time like in analyzeVertexCache
+    size_t lineCount = (vertexCount * vertexSize + VERTEX_FETCH_LINE_SIZE - 1) / VERTEX_FETCH_LINE_SIZE;
+    uint32_t* vertexTime = (uint32_t*)alloc(allocator, vertexCount * sizeof(uint32_t), alignof(uint32_t));
+    uint32_t* lineTime = (uint32_t*)alloc(allocator, lineCount * sizeof(uint32_t), alignof(uint32_t));
+    memset(vertexTime, 0, vertexCount * sizeof(uint32_t));
+    memset(lineTime, 0, lineCount * sizeof(uint32_t));
+
+    uint32_t time = VERTEX_CACHE_SIZE + 1;
+    uint32_t lineClock = VERTEX_FETCH_CACHE_LINES + 1;
+    size_t referenced = 0;
+
+    VertexFetchStats result{};
+    for(size_t i=0;i<indexCount;i++){
+        uint32_t v = indices[i];
+        if(vertexTime[v] == 0) referenced++;
+        if(time - vertexTime[v] <= VERTEX_CACHE_SIZE) continue;
+        vertexTime[v] = time++;
+
+        size_t first = v * vertexSize / VERTEX_FETCH_LINE_SIZE;
+        size_t last = (v * vertexSize + vertexSize - 1) / VERTEX_FETCH_LINE_SIZE;
+        for(size_t line=first;line<=last;line++){
+            if(lineClock - lineTime[line] > VERTEX_FETCH_CACHE_LINES){
+                lineTime[line] = lineClock++;
+                result.bytesFetched += VERTEX_FETCH_LINE_SIZE;
+            }
+        }
+    }
+
+    result.overfetch = referenced ? (float)result.bytesFetched / (referenced * vertexSize) : 0.0f;
+    return result;
+}
+
+size_t optimizeVertexFetch(void* destination, uint32_t* indices, size_t indexCount, const void* vertices,
+    size_t vertexCount, size_t vertexSize){
+    Scratch scratch;
+    Allocator& allocator = scratch.allocator();
+
+    if(destination == vertices){
+        void* copy = alloc(allocator, vertexCount * vertexSize, 16);
+        memcpy(copy, vertices, vertexCount * vertexSize);
+        vertices = copy;
+    }
+
+    uint32_t* remap = (uint32_t*)alloc(allocator, vertexCount * sizeof(uint32_t), alignof(uint32_t));
+    memset(remap, 0xff, vertexCount * sizeof(uint32_t));
+
+    uint32_t next = 0;
+    for(size_t i=0;i<indexCount;i++){
+        uint32_t v = indices[i];
+        if(remap[v] == UINT32_MAX){
+            remap[v] = next;
+            memcpy((uint8_t*)destination + (size_t)next * vertexSize, (const uint8_t*)vertices + v * vertexSize, vertexSize);
+            next++;
+        }
+        indices[i] = remap[v];
+    }
+
+    return next;
+}
+
+// Reads a position out of a strided vertex stream
+static glm::vec3 getPosition(const float* positions, size_t positionStride, uint32_t v){
+    const float* p = (const float*)((const uint8_t*)positions + v * positionStride);
+    return glm::vec3(p[0], p[1], p[2]);
+}
+
+// Depth tested fill of one triangle in viewport coordinates, counter clockwise
+// is front facing. Pixel centers exactly on an edge go to both triangles
+static void rasterizeTriangle(float* depth, uint64_t& shaded, glm::vec3 a, glm::vec3 b, glm::vec3 c){
+    float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+    if(area <= 0.0f) return;
+
+    int minX = (int)glm::max(floorf(glm::min(a.x, glm::min(b.x, c.x))), 0.0f);
+    int minY = (int)glm::max(floorf(glm::min(a.y, glm::min(b.y, c.y))), 0.0f);
+    int maxX = (int)glm::min(ceilf(glm::max(a.x, glm::max(b.x, c.x))), (float)OVERDRAW_VIEWPORT);
+    int maxY = (int)glm::min(ceilf(glm::max(a.y, glm::max(b.y, c.y))), (float)OVERDRAW_VIEWPORT);
+
+    for(int y=minY;y<maxY;y++){
+        for(int x=minX;x<maxX;x++){
+            float px = x + 0.5f, py = y + 0.5f;
+            float wa = (c.x - b.x) * (py - b.y) - (c.y - b.y) * (px - b.x);
+            float wb = (a.x - c.x) * (py - c.y) - (a.y - c.y) * (px - c.x);
+            float wc = area - wa - wb;
+            if(wa < 0.0f || wb < 0.0f || wc < 0.0f) continue;
+
+            float z = (wa * a.z + wb * b.z + wc * c.z) / area;
+            float& stored = depth[y * OVERDRAW_VIEWPORT + x];
+            if(z < stored){
+                stored = z;
+                shaded++;
+            }
+        }
+    }
+}
+
+OverdrawStats analyzeOverdraw(const uint32_t* indices, size_t indexCount, const float* positions, size_t vertexCount,
+    size_t positionStride){
+    assert(indexCount % 3 == 0);
+    OverdrawStats result{};
+    if(vertexCount == 0) return result;
+
+    glm::vec3 boundsMin = getPosition(positions, positionStride, 0);
+    glm::vec3 boundsMax = boundsMin;
+    for(uint32_t v=1;v<vertexCount;v++){
+        boundsMin = glm::min(boundsMin, getPosition(positions, positionStride, v));
+        boundsMax = glm::max(boundsMax, getPosition(positions, positionStride, v));
+    }
+    glm::vec3 extent = boundsMax - boundsMin;
+    float scale = glm::max(extent.x, glm::max(extent.y, extent.z));
+    scale = scale > 0.0f ? 1.0f / scale : 0.0f;
+
+    Scratch scratch;
+    float* depth = (float*)alloc(scratch.allocator(), OVERDRAW_VIEWPORT * OVERDRAW_VIEWPORT * sizeof(float), alignof(float));
+
+    for(uint32_t view=0;view<6;view++){
+        uint32_t axis = view >> 1;
+        bool back = view & 1;
+        for(uint32_t i=0;i<OVERDRAW_VIEWPORT*OVERDRAW_VIEWPORT;i++)
+            depth[i] = 2.0f;
+
+        for(size_t i=0;i<indexCount;i+=3){
+            glm::vec3 corners[3];
+            for(uint32_t k=0;k<3;k++){
+                glm::vec3 p = (getPosition(positions, positionStride, indices[i+k]) - boundsMin) * scale;
+                // looking down -axis, or down +axis mirrored so winding still tells the facing
+                float u = p[(axis + 1) % 3], w = p[(axis + 2) % 3], z = p[axis];
+                corners[k] = back ? glm::vec3(1.0f - u, w, z) : glm::vec3(u, w, 1.0f - z);
+                corners[k].x *= OVERDRAW_VIEWPORT;
+                corners[k].y *= OVERDRAW_VIEWPORT;
+            }
+            rasterizeTriangle(depth, result.shaded, corners[0], corners[1], corners[2]);
+        }
+
+        for(uint32_t i=0;i<OVERDRAW_VIEWPORT*OVERDRAW_VIEWPORT;i++)
+            result.covered += depth[i] < 2.0f;
+    }
+
+    result.overdraw = result.covered ? (float)result.shaded / result.covered : 0.0f;
+    return result;
+}
+
+size_t optimizeOverdraw(uint32_t* destination, const uint32_t* indices, size_t indexCount, const float* positions,
+    size_t vertexCount, size_t positionStride, float threshold, uint32_t cacheSize){
+    assert(indexCount % 3 == 0);
+    size_t triangleCount = indexCount / 3;
+    if(triangleCount == 0) return 0;
+
+    Scratch scratch;
+    Allocator& allocator = scratch.allocator();
+
+    if(destination == indices){
+        uint32_t* copy = (uint32_t*)alloc(allocator, indexCount * sizeof(uint32_t), alignof(uint32_t));
+        memcpy(copy, indices, indexCount * sizeof(uint32_t));
+        indices = copy;
+    }
+
+    // FIFO by miss time, skipping cacheSize ticks empties it
+    uint32_t* missTime = (uint32_t*)alloc(allocator, vertexCount * sizeof(uint32_t), alignof(uint32_t));
+    memset(missTime, 0, vertexCount * sizeof(uint32_t));
+    uint32_t time = cacheSize + 1;
+    auto countMisses = [&](size_t t){
+        uint32_t misses = 0;
+        for(uint32_t k=0;k<3;k++){
+            uint32_t v = indices[3*t+k];
+            if(time - missTime[v] > cacheSize){
+                missTime[v] = time++;
+                misses++;
+            }
+        }
+        return misses;
+    };
+
+    // hard boundaries where the optimizer restarted, no corner was cached. The
+    // first triangle always starts one, a degenerate one misses fewer than 3
+    uint32_t* hard = (uint32_t*)alloc(allocator, (triangleCount + 1) * sizeof(uint32_t), alignof(uint32_t));
+    size_t hardCount = 0;
+    hard[hardCount++] = 0;
+    for(size_t t=0;t<triangleCount;t++){
+        uint32_t misses = countMisses(t);
+        if(t > 0 && misses == 3) hard[hardCount++] = (uint32_t)t;
+    }
+    hard[hardCount] = (uint32_t)triangleCount;
+
+    // soft boundaries inside each, wherever the part so far is within the
+    // threshold of the whole cluster starting with an empty cache
+    uint32_t* clusters = (uint32_t*)alloc(allocator, (triangleCount + 1) * sizeof(uint32_t), alignof(uint32_t));
+    size_t clusterCount = 0;
+    for(size_t h=0;h<hardCount;h++){
+        size_t begin = hard[h], end = hard[h+1];
+
+        time += cacheSize + 1;
+        uint32_t misses = 0;
+        for(size_t t=begin;t<end;t++)
+            misses += countMisses(t);
+        float limit = threshold * misses / (end - begin);
+
+        time += cacheSize + 1;
+        clusters[clusterCount++] = (uint32_t)begin;
+        size_t start = begin;
+        misses = 0;
+        for(size_t t=begin;t<end;t++){
+            misses += countMisses(t);
+            if(t + 1 < end && (float)misses / (t + 1 - start) <= limit){
+                clusters[clusterCount++] = (uint32_t)(t + 1);
+                start = t + 1;
+                misses = 0;
+                time += cacheSize + 1;
+            }
+        }
+    }
+    clusters[clusterCount] = (uint32_t)triangleCount;
+
+    // area weighted center and normal of every cluster and of the whole mesh
+    glm::vec3* centers = (glm::vec3*)alloc(allocator, clusterCount * sizeof(glm::vec3), alignof(glm::vec3));
+    glm::vec3* normals = (glm::vec3*)alloc(allocator, clusterCount * sizeof(glm::vec3), alignof(glm::vec3));
+    glm::vec3 meshCenter(0.0f);
+    float meshArea = 0.0f;
+
+    for(size_t c=0;c<clusterCount;c++){
+        glm::vec3 center(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for(size_t t=clusters[c];t<clusters[c+1];t++){
+            glm::vec3 a = getPosition(positions, positionStride, indices[3*t+0]);
+            glm::vec3 b = getPosition(positions, positionStride, indices[3*t+1]);
+            glm::vec3 d = getPosition(positions, positionStride, indices[3*t+2]);
+            glm::vec3 n = glm::cross(b - a, d - a);
+            float triangleArea = glm::length(n);
+
+            center += (a + b + d) * (triangleArea / 3.0f);
+            normal += n;
+            area += triangleArea;
+        }
+
+        meshCenter += center;
+        meshArea += area;
+        centers[c] = area > 0.0f ? center / area : center;
+        float length = glm::length(normal);
+        normals[c] = length > 0.0f ? normal / length : normal;
+    }
+    if(meshArea > 0.0f) meshCenter /= meshArea;
+
+    // how far a cluster faces out from the center, outer ones draw first
+    float* sortKey = (float*)alloc(allocator, clusterCount * sizeof(float), alignof(float));
+    uint32_t* order = (uint32_t*)alloc(allocator, clusterCount * sizeof(uint32_t), alignof(uint32_t));
+    for(size_t c=0;c<clusterCount;c++){
+        sortKey[c] = glm::dot(centers[c] - meshCenter, normals[c]);
+        order[c] = (uint32_t)c;
+    }
+    std::stable_sort(order, order + clusterCount, [&](uint32_t l, uint32_t r){ return sortKey[l] > sortKey[r]; });
+
+    size_t written = 0;
+    for(size_t i=0;i<clusterCount;i++){
+        uint32_t c = order[i];
+        size_t count = 3 * (clusters[c+1] - clusters[c]);
+        memcpy(destination + written, indices + 3 * clusters[c], count * sizeof(uint32_t));
+        written += count;
+    }
+    assert(written == indexCount);
+
+    return clusterCount;
+}
+
+size_t buildMeshletsBound(size_t indexCount, uint32_t maxVertices, uint32_t maxTriangles){
+    assert(maxVertices >= 3 && maxVertices <= 255 && maxTriangles >= 1);
+
+    // every meshlet but the last is full in either vertices or triangles,
+    // a triangle brings at most 3 vertices so a vertex full one wastes up to 2
+    size_t byVertices = (indexCount + maxVertices - 3) / (maxVertices - 2);
+    size_t byTriangles = (indexCount / 3 + maxTriangles - 1) / maxTriangles;
+    return glm::max(byVertices, byTriangles);
+}
+
+size_t buildMeshlets(Meshlet* meshlets, uint32_t* meshletVertices, uint8_t* meshletTriangles, const uint32_t* indices,
+    size_t indexCount, size_t vertexCount, uint32_t maxVertices, uint32_t maxTriangles){
+    assert(indexCount % 3 == 0);
+    assert(maxVertices >= 3 && maxVertices <= 255 && maxTriangles >= 1);
+
+    Scratch scratch;
+    // position of each vertex in the open meshlet, 0xff when it is not in it
+    uint8_t* local = (uint8_t*)alloc(scratch.allocator(), vertexCount, 1);
+    memset(local, 0xff, vertexCount);
+
+    size_t meshletCount = 0;
+    Meshlet current{};
+
+    for(size_t i=0;i<indexCount;i+=3){
+        uint32_t a = indices[i], b = indices[i+1], c = indices[i+2];
+        uint32_t added = (local[a] == 0xff) + (local[b] == 0xff) + (local[c] == 0xff);
+
+        if(current.vertexCount + added > maxVertices || current.triangleCount + 1 > maxTriangles){
+            for(uint32_t v=0;v<current.vertexCount;v++)
+                local[meshletVertices[current.vertexOffset + v]] = 0xff;
+
+            meshlets[meshletCount++] = current;
+            current.vertexOffset += current.vertexCount;
+            current.triangleOffset += (uint32_t)alignPow2(current.triangleCount * 3, 4);
+            current.vertexCount = 0;
+            current.triangleCount = 0;
+        }
+
+        uint8_t* triangle = meshletTriangles + current.triangleOffset + current.triangleCount * 3;
+        uint32_t corners[3] = {a, b, c};
+        for(uint32_t k=0;k<3;k++){
+            uint32_t v = corners[k];
+            if(local[v] == 0xff){
+                local[v] = (uint8_t)current.vertexCount;
+                meshletVertices[current.vertexOffset + current.vertexCount++] = v;
+            }
+            triangle[k] = local[v];
+        }
+        current.triangleCount++;
+    }
+
+    if(current.triangleCount > 0)
+        meshlets[meshletCount++] = current;
+
+    return meshletCount;
+}
+
+MeshletBounds computeMeshletBounds(const Meshlet& meshlet, const uint32_t* meshletVertices, const uint8_t* meshletTriangles,
+    const float* positions, size_t positionStride){
+    const uint32_t* vertices = meshletVertices + meshlet.vertexOffset;
+    const uint8_t* triangles = meshletTriangles + meshlet.triangleOffset;
+
+    MeshletBounds result{};
+    result.coneCutoff = 1.0f;
+    if(meshlet.triangleCount == 0) return result;
+
+    // Ritter: start from the widest pair of axis extremes and grow to cover the rest
+    uint32_t extremes[6] = {};
+    for(uint32_t i=0;i<meshlet.vertexCount;i++){
+        glm::vec3 p = getPosition(positions, positionStride, vertices[i]);
+        for(uint32_t axis=0;axis<3;axis++){
+            if(p[axis] < getPosition(positions, positionStride, vertices[extremes[2*axis]])[axis]) extremes[2*axis] = i;
+            if(p[axis] > getPosition(positions, positionStride, vertices[extremes[2*axis+1]])[axis]) extremes[2*axis+1] = i;
+        }
+    }
+
+    float widest = -1.0f;
+    for(uint32_t axis=0;axis<3;axis++){
+        glm::vec3 low = getPosition(positions, positionStride, vertices[extremes[2*axis]]);
+        glm::vec3 high = getPosition(positions, positionStride, vertices[extremes[2*axis+1]]);
+        float span = glm::length(high - low);
+        if(span > widest){
+            widest = span;
+            result.center = (low + high) * 0.5f;
+            result.radius = span * 0.5f;
+        }
+    }
+
+    for(uint32_t i=0;i<meshlet.vertexCount;i++){
+        glm::vec3 p = getPosition(positions, positionStride, vertices[i]);
+        float distance = glm::length(p - result.center);
+        if(distance > result.radius){
+            float grown = (result.radius + distance) * 0.5f;
+            result.center += (p - result.center) * ((grown - result.radius) / distance);
+            result.radius = grown;
+        }
+    }
+
+    // cone around the average of the triangle normals
+    glm::vec3 normalSum(0.0f);
+    for(uint32_t t=0;t<meshlet.triangleCount;t++){
+        glm::vec3 a = getPosition(positions, positionStride, vertices[triangles[3*t+0]]);
+        glm::vec3 b = getPosition(positions, positionStride, vertices[triangles[3*t+1]]);
+        glm::vec3 c = getPosition(positions, positionStride, vertices[triangles[3*t+2]]);
+        glm::vec3 n = glm::cross(b - a, c - a);
+        float length = glm::length(n);
+        if(length > 0.0f) normalSum += n / length;
+    }
+
+    float axisLength = glm::length(normalSum);
+    result.coneAxis = axisLength > 0.0f ? normalSum / axisLength : glm::vec3(0.0f, 0.0f, 1.0f);
+    result.coneApex = result.center;
+
+    float minDot = 1.0f;
+    for(uint32_t t=0;t<meshlet.triangleCount;t++){
+        glm::vec3 a = getPosition(positions, positionStride, vertices[triangles[3*t+0]]);
+        glm::vec3 b = getPosition(positions, positionStride, vertices[triangles[3*t+1]]);
+        glm::vec3 c = getPosition(positions, positionStride, vertices[triangles[3*t+2]]);
+        glm::vec3 n = glm::cross(b - a, c - a);
+        float length = glm::length(n);
+        if(length > 0.0f) minDot = glm::min(minDot, glm::dot(n / length, result.coneAxis));
+    }
+
+    // normals spread over close to a hemisphere leave nothing worth culling
+    if(axisLength == 0.0f || minDot <= 0.1f) return result;
+
+    // move the apex back along the axis until it is behind every triangle plane,
+    // (apex - a).n <= 0, concave meshlets move it furthest
+    float maxT = 0.0f;
+    for(uint32_t t=0;t<meshlet.triangleCount;t++){
+        glm::vec3 a = getPosition(positions, positionStride, vertices[triangles[3*t+0]]);
+        glm::vec3 b = getPosition(positions, positionStride, vertices[triangles[3*t+1]]);
+        glm::vec3 c = getPosition(positions, positionStride, vertices[triangles[3*t+2]]);
+        glm::vec3 n = glm::cross(b - a, c - a);
+        float length = glm::length(n);
+        if(length == 0.0f) continue;
+        n /= length;
+
+        maxT = glm::max(maxT, glm::dot(result.center - a, n) / glm::dot(result.coneAxis, n));
+    }
+
+    result.coneApex = result.center - result.coneAxis * maxT;
+    result.coneCutoff = sqrtf(1.0f - minDot * minDot);
+    return result;
+}
+
+// Area weighted sum of squared distances to planes, Q(p) = p'Ap + 2b'p + c
+struct Quadric{
+    float a00, a01, a02, a11, a12, a22;
+    float b0, b1, b2;
+    float c;
+    float weight;
+};
+
+static void addPlane(Quadric& q, glm::vec3 n, float d, float weight){
+    q.a00 += weight * n.x * n.x;
+    q.a01 += weight * n.x * n.y;
+    q.a02 += weight * n.x * n.z;
+    q.a11 += weight * n.y * n.y;
+    q.a12 += weight * n.y * n.z;
+    q.a22 += weight * n.z * n.z;
+    q.b0 += weight * n.x * d;
+    q.b1 += weight * n.y * d;
+    q.b2 += weight * n.z * d;
+    q.c += weight * d * d;
+    q.weight += weight;
+}
+
+static void addQuadric(Quadric& q, const Quadric& other){
+    float* dst = &q.a00;
+    const float* src = &other.a00;
+    for(uint32_t i=0;i<sizeof(Quadric)/sizeof(float);i++)
+        dst[i] += src[i];
+}
+
+// Mean squared plane distance of p for the sum of two quadrics
+static float quadricError(const Quadric& q, const Quadric& r, glm::vec3 p){
+    float a00 = q.a00 + r.a00, a01 = q.a01 + r.a01, a02 = q.a02 + r.a02;
+    float a11 = q.a11 + r.a11, a12 = q.a12 + r.a12, a22 = q.a22 + r.a22;
+    float weight = q.weight + r.weight;
+
+    float sum = p.x * (a00 * p.x + 2.0f * (a01 * p.y + a02 * p.z)) + p.y * (a11 * p.y + 2.0f * a12 * p.z) + a22 * p.z * p.z +
+        2.0f * ((q.b0 + r.b0) * p.x + (q.b1 + r.b1) * p.y + (q.b2 + r.b2) * p.z) + q.c + r.c;
+    return weight > 0.0f ? glm::max(sum, 0.0f) / weight : 0.0f;
+}
+
+// Moving u onto v, error is geometric and cost adds the attribute change
+struct Collapse{
+    uint32_t u, v;
+    float cost;
+    float error;
+};
+
+size_t simplifyMesh(uint32_t* destination, const uint32_t* indices, size_t indexCount, const float* positions,
+    size_t vertexCount, size_t positionStride, const float* attributes, size_t attributeStride, uint32_t attributeCount,
+    float attributeWeight, size_t targetIndexCount, float targetError, float* resultError){
+    assert(indexCount % 3 == 0);
+    if(resultError) *resultError = 0.0f;
+
+    Scratch scratch;
+    Allocator& allocator = scratch.allocator();
+
+    uint32_t* current = (uint32_t*)alloc(allocator, indexCount * sizeof(uint32_t), alignof(uint32_t));
+    memcpy(current, indices, indexCount * sizeof(uint32_t));
+    size_t count = indexCount;
+
+    // errors are measured in the unit cube of the bounds
+    glm::vec3 boundsMin = vertexCount ? getPosition(positions, positionStride, 0) : glm::vec3(0.0f);
+    glm::vec3 boundsMax = boundsMin;
+    for(uint32_t v=1;v<vertexCount;v++){
+        boundsMin = glm::min(boundsMin, getPosition(positions, positionStride, v));
+        boundsMax = glm::max(boundsMax, getPosition(positions, positionStride, v));
+    }
+    glm::vec3 extent = boundsMax - boundsMin;
+    float size = glm::max(extent.x, glm::max(extent.y, extent.z));
+    float scale = size > 0.0f ? 1.0f / size : 0.0f;
+    float errorLimit = targetError * scale * targetError * scale;
+
+    glm::vec3* points = (glm::vec3*)alloc(allocator, vertexCount * sizeof(glm::vec3), alignof(glm::vec3));
+    for(uint32_t v=0;v<vertexCount;v++)
+        points[v] = (getPosition(positions, positionStride, v) - boundsMin) * scale;
+
+    // vertices at one position are wedges split by an attribute seam, they
+    // share the first one's quadric and are locked
+    uint32_t* wedge = (uint32_t*)alloc(allocator, vertexCount * sizeof(uint32_t), alignof(uint32_t));
+    uint8_t* locked = (uint8_t*)alloc(allocator, vertexCount, 1);
+    memset(locked, 0, vertexCount);
+    {
+        HashMap<glm::vec3, uint32_t> firstAt(allocator, vertexCount);
+        for(uint32_t v=0;v<vertexCount;v++){
+            bool inserted = false;
+            uint32_t first = firstAt.findOrInsert(getPosition(positions, positionStride, v), v, &inserted);
+            wedge[v] = first;
+            if(!inserted) locked[v] = locked[first] = 1;
+        }
+    }
+
+    // border edges have no opposite half edge across wedges
+    {
+        HashMap<uint64_t, uint32_t> halfEdges(allocator, indexCount);
+        for(size_t i=0;i<count;i+=3){
+            for(uint32_t k=0;k<3;k++){
+                uint64_t a = wedge[current[i+k]], b = wedge[current[i+(k+1)%3]];
+                halfEdges.findOrInsert(a << 32 | b, 0);
+            }
+        }
+        for(size_t i=0;i<count;i+=3){
+            for(uint32_t k=0;k<3;k++){
+                uint32_t a = current[i+k], b = current[i+(k+1)%3];
+                if(!halfEdges.find((uint64_t)wedge[b] << 32 | wedge[a]))
+                    locked[a] = locked[b] = 1;
+            }
+        }
+    }
+
+    Quadric* quadrics = (Quadric*)alloc(allocator, vertexCount * sizeof(Quadric), alignof(Quadric));
+    memset(quadrics, 0, vertexCount * sizeof(Quadric));
+    for(size_t i=0;i<count;i+=3){
+        glm::vec3 a = points[current[i]], b = points[current[i+1]], c = points[current[i+2]];
+        glm::vec3 n = glm::cross(b - a, c - a);
+        float length = glm::length(n);
+        if(length == 0.0f) continue;
+        n /= length;
+
+        for(uint32_t k=0;k<3;k++)
+            addPlane(quadrics[wedge[current[i+k]]], n, -glm::dot(n, a), length * 0.5f);
+    }
+
+    uint32_t* adjacencyOffset = (uint32_t*)alloc(allocator, (vertexCount + 1) * sizeof(uint32_t), alignof(uint32_t));
+    uint32_t* adjacency = (uint32_t*)alloc(allocator, indexCount * sizeof(uint32_t), alignof(uint32_t));
+    uint32_t* collapseTo = (uint32_t*)alloc(allocator, vertexCount * sizeof(uint32_t), alignof(uint32_t));
+    uint8_t* touched = (uint8_t*)alloc(allocator, vertexCount, 1);
+    Collapse* candidates = (Collapse*)alloc(allocator, indexCount * sizeof(Collapse), alignof(Collapse));
+
+    auto evaluate = [&](uint32_t u, uint32_t v){
+        Collapse result{u, v, 0.0f, quadricError(quadrics[wedge[u]], quadrics[wedge[v]], points[v])};
+        float change = 0.0f;
+        if(attributeCount > 0){
+            const float* au = (const float*)((const uint8_t*)attributes + u * attributeStride);
+            const float* av = (const float*)((const uint8_t*)attributes + v * attributeStride);
+            for(uint32_t i=0;i<attributeCount;i++)
+                change += (au[i] - av[i]) * (au[i] - av[i]);
+        }
+        result.cost = result.error + attributeWeight * attributeWeight * change;
+        return result;
+    };
+
+    float worst = 0.0f;
+
+    // each pass collapses the cheapest edges whose neighbourhoods do not overlap
+    while(count > targetIndexCount){
+        memset(adjacencyOffset, 0, (vertexCount + 1) * sizeof(uint32_t));
+        for(size_t i=0;i<count;i++)
+            adjacencyOffset[current[i] + 1]++;
+        for(size_t v=0;v<vertexCount;v++)
+            adjacencyOffset[v+1] += adjacencyOffset[v];
+        for(size_t i=0;i<count;i++)
+            adjacency[adjacencyOffset[current[i]]++] = (uint32_t)(i / 3);
+        // the fill advanced every offset to the next vertex's start
+        for(size_t v=vertexCount;v>0;v--)
+            adjacencyOffset[v] = adjacencyOffset[v-1];
+        adjacencyOffset[0] = 0;
+
+        // interior edges appear ascending in one of their triangles, locked ends cannot move
+        size_t candidateCount = 0;
+        for(size_t i=0;i<count;i+=3){
+            for(uint32_t k=0;k<3;k++){
+                uint32_t a = current[i+k], b = current[i+(k+1)%3];
+                if(a >= b || (locked[a] && locked[b])) continue;
+
+                Collapse ab = locked[a] ? Collapse{} : evaluate(a, b);
+                Collapse ba = locked[b] ? Collapse{} : evaluate(b, a);
+                candidates[candidateCount++] = locked[a] || (!locked[b] && ba.cost < ab.cost) ? ba : ab;
+            }
+        }
+        std::sort(candidates, candidates + candidateCount, [](const Collapse& l, const Collapse& r){ return l.cost < r.cost; });
+
+        memset(touched, 0, vertexCount);
+        for(uint32_t v=0;v<vertexCount;v++)
+            collapseTo[v] = v;
+
+        // a collapse removes about two triangles
+        size_t budget = (count - targetIndexCount) / 6 + 1;
+        size_t collapses = 0;
+
+        for(size_t c=0;c<candidateCount && collapses<budget;c++){
+            const Collapse& collapse = candidates[c];
+            uint32_t u = collapse.u, v = collapse.v;
+            if(collapse.error > errorLimit || touched[u] || touched[v]) continue;
+
+            // the triangles that stay must not turn over
+            bool flips = false;
+            for(uint32_t a=adjacencyOffset[u];a<adjacencyOffset[u+1] && !flips;a++){
+                const uint32_t* triangle = current + 3 * adjacency[a];
+                if(triangle[0] == v || triangle[1] == v || triangle[2] == v) continue;
+
+                glm::vec3 before[3], after[3];
+                for(uint32_t k=0;k<3;k++){
+                    before[k] = points[triangle[k]];
+                    after[k] = triangle[k] == u ? points[v] : before[k];
+                }
+                glm::vec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+                glm::vec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+                flips = glm::dot(n0, n1) <= 0.0f;
+            }
+            if(flips) continue;
+
+            collapseTo[u] = v;
+            addQuadric(quadrics[wedge[v]], quadrics[wedge[u]]);
+            worst = glm::max(worst, collapse.error);
+            collapses++;
+
+            for(uint32_t a=adjacencyOffset[u];a<adjacencyOffset[u+1];a++){
+                const uint32_t* triangle = current + 3 * adjacency[a];
+                touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = 1;
+            }
+        }
+        if(collapses == 0) break;
+
+        // triangles that lost a corner go away
+        size_t written = 0;
+        for(size_t i=0;i<count;i+=3){
+            uint32_t a = collapseTo[current[i]], b = collapseTo[current[i+1]], c = collapseTo[current[i+2]];
+            if(a == b || b == c || a == c) continue;
+            current[written++] = a;
+            current[written++] = b;
+            current[written++] = c;
+        }
+        count = written;
+    }
+
+    memcpy(destination, current, count * sizeof(uint32_t));
+    if(resultError) *resultError = sqrtf(worst) * size;
+    return count;
+}
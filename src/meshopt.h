@@ -0,0 +1,122 @@
+#pragma once
+#include <glm/vec3.hpp>
+
+#include "common.h"
+
+// Post transform cache entries the optimizer targets, small enough that
+// newer GPUs with bigger or batch based caches still benefit
+#define VERTEX_CACHE_SIZE 16
+
+// Measured with a FIFO cache, acmr is vertex shader runs per triangle (0.5 is
+// ideal on closed meshes, 3 is no reuse at all) and atvr runs per vertex (1 is ideal)
+struct VertexCacheStats{
+    uint32_t transformed;
+    float acmr;
+    float atvr;
+};
+
+VertexCacheStats analyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount,
+    uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+// Reorders triangles for post transform cache hits with Tipsify (Sander,
+// Nehab, Barczak 2007), linear in the triangle count. destination may be indices
+void optimizeVertexCache(uint32_t* destination, const uint32_t* indices, size_t indexCount, size_t vertexCount,
+    uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+// Cache the fetch analysis simulates, about what one shader core sees of L1
+#define VERTEX_FETCH_LINE_SIZE 64
+#define VERTEX_FETCH_CACHE_LINES 64
+
+// Memory traffic of the vertices the post transform cache missed, overfetch is
+// fetched bytes per byte of referenced vertices (1 is ideal)
+struct VertexFetchStats{
+    uint64_t bytesFetched;
+    float overfetch;
+};
+
+VertexFetchStats analyzeVertexFetch(const uint32_t* indices, size_t indexCount, size_t vertexCount, size_t vertexSize);
+
+// Renumbers vertices in the order the indices first use them so consecutive
+// triangles fetch neighbouring memory, run it after every triangle reorder.
+// Unreferenced vertices are dropped, returns the vertices written. destination may be vertices
+size_t optimizeVertexFetch(void* destination, uint32_t* indices, size_t indexCount, const void* vertices,
+    size_t vertexCount, size_t vertexSize);
+
+// Resolution of each of the views the overdraw analysis renders
+#define OVERDRAW_VIEWPORT 256
+// Vertex cache efficiency the overdraw optimizer may give up, 1.05 keeps ACMR within 5%
+#define OVERDRAW_THRESHOLD 1.05f
+
+// Rendered from both sides of every axis with back faces culled, overdraw is
+// fragments shaded per pixel covered (1 is ideal)
+struct OverdrawStats{
+    uint64_t covered;
+    uint64_t shaded;
+    float overdraw;
+};
+
+// positions is the first of 3 floats every positionStride bytes
+OverdrawStats analyzeOverdraw(const uint32_t* indices, size_t indexCount, const float* positions, size_t vertexCount,
+    size_t positionStride);
+
+// Splits cache optimized triangles into clusters where the cache restarts and
+// wherever the threshold allows, then draws the clusters that face away from
+// the mesh center first since they occlude the rest from most views. Returns
+// the cluster count. destination may be indices
+size_t optimizeOverdraw(uint32_t* destination, const uint32_t* indices, size_t indexCount, const float* positions,
+    size_t vertexCount, size_t positionStride, float threshold = OVERDRAW_THRESHOLD, uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+// Meshlet limits that suit mesh shader workgroups, 124 triangles keep the
+// micro indices of one meshlet within 372 bytes
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+// A cluster of triangles that index its own vertex list with bytes.
+// meshletTriangles holds 3 local indices per triangle from triangleOffset,
+// which is 4 byte aligned so shaders can read it as words
+struct Meshlet{
+    uint32_t vertexOffset;
+    uint32_t triangleOffset;
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+};
+
+// Bounding sphere and normal cone of a meshlet. The meshlet faces away from a
+// camera when dot(normalize(coneApex - camera), coneAxis) >= coneCutoff, a
+// cutoff of 1 never culls
+struct MeshletBounds{
+    glm::vec3 center;
+    float radius;
+    glm::vec3 coneApex;
+    float coneCutoff; // sine of the cone half angle
+    glm::vec3 coneAxis;
+    float reserved;
+};
+
+// Meshlets that indexCount indices split into at most
+size_t buildMeshletsBound(size_t indexCount, uint32_t maxVertices = MESHLET_MAX_VERTICES,
+    uint32_t maxTriangles = MESHLET_MAX_TRIANGLES);
+
+// Splits triangles into meshlets in their current order, which after the
+// cache optimizer is spatially compact fans. meshletVertices needs room for
+// indexCount entries and meshletTriangles for the bound times maxTriangles * 3
+// rounded up to 4. Returns the meshlets written
+size_t buildMeshlets(Meshlet* meshlets, uint32_t* meshletVertices, uint8_t* meshletTriangles, const uint32_t* indices,
+    size_t indexCount, size_t vertexCount, uint32_t maxVertices = MESHLET_MAX_VERTICES,
+    uint32_t maxTriangles = MESHLET_MAX_TRIANGLES);
+
+MeshletBounds computeMeshletBounds(const Meshlet& meshlet, const uint32_t* meshletVertices, const uint8_t* meshletTriangles,
+    const float* positions, size_t positionStride);
+
+// Collapses edges in order of quadric error (Garland, Heckbert 1997) until at
+// most targetIndexCount indices are left or every remaining collapse would
+// exceed targetError, in position units. Vertices on borders and attribute
+// seams never move. attributeCount floats every attributeStride bytes add
+// attributeWeight times their change to the cost, in units of the mesh extent.
+// resultError receives the largest error of a collapse made, the square root
+// of the area weighted mean squared plane distance of its quadric. That is an
+// RMS estimate of how far the surface moved, not a bound on the distance.
+// Returns the indices written, destination may be indices
+size_t simplifyMesh(uint32_t* destination, const uint32_t* indices, size_t indexCount, const float* positions,
+    size_t vertexCount, size_t positionStride, const float* attributes, size_t attributeStride, uint32_t attributeCount,
+    float attributeWeight, size_t targetIndexCount, float targetError, float* resultError);
@@ -0,0 +1,109 @@
+#include "pool.h"
+
+
+Allocator poolNew(uint64_t slab_bytes) {
+    assert(slab_bytes >= POOL_MAX_SIZE * 2);
+
+    Pool* pool = (Pool*)calloc(1, sizeof(Pool));
+    if (pool == nullptr) {
+        printf("Error, failed to allocate pool allocator members\n");
+        exit(-1);
+    }
+
+    pool->slab_size = slab_bytes;
+
+    return {
+        .alloc = poolAlloc,
+        .dealloc = poolDealloc,
+        .data = pool
+    };
+}
+
+// Blocks are naturally aligned to their power of two size as slabs start on a
+// page boundary, so a size class also satisfies any alignment up to its size
+internal uint32_t poolSizeClass(uint64_t bytes) {
+    if (bytes <= POOL_MIN_SIZE) {
+        return 0;
+    }
+
+    return bitScanReverse(bytes - 1) + 1 - bitScanReverse(POOL_MIN_SIZE);
+}
+
+// Maps a new slab and makes it the bump region of the size class
+internal void poolGrow(Pool* pool, PoolSizeClass& size_class, uint64_t class_size) {
+    VirtualMemoryBlock block = osAlloc(pool->slab_size);
+
+    PoolSlab* slab = (PoolSlab*)block.memory;
+    slab->next = pool->slabs;
+    slab->size = block.size;
+    pool->slabs = slab;
+
+    size_class.cursor = (uint8_t*)block.memory + alignPow2(sizeof(PoolSlab), class_size);
+    size_class.end = (uint8_t*)block.memory + block.size;
+}
+
+void* poolAlloc(Allocator& allocator, uint64_t bytes, uint64_t alignment) {
+    assert(allocator.data != nullptr && bytes > 0);
+
+    Pool* pool = (Pool*)allocator.data;
+    if (bytes > POOL_MAX_SIZE) {
+        assert(alignment <= osPageSize());
+        return osAlloc(bytes).memory;
+    }
+
+    uint32_t index = poolSizeClass(bytes);
+    uint64_t class_size = (uint64_t)POOL_MIN_SIZE << index;
+    assert(alignment <= class_size);
+
+    PoolSizeClass& size_class = pool->classes[index];
+    if (size_class.free_list != nullptr) {
+        void* ptr = size_class.free_list;
+        size_class.free_list = *(void**)ptr;
+        return ptr;
+    }
+
+    if (size_class.cursor + class_size > size_class.end) {
+        poolGrow(pool, size_class, class_size);
+    }
+
+    void* ptr = size_class.cursor;
+    size_class.cursor += class_size;
+    return ptr;
+}
+
+void poolDealloc(Allocator& allocator, uint64_t bytes, ...) {
+    assert(allocator.data != nullptr && bytes > 0);
+
+    va_list args;
+    va_start(args, bytes);
+    void* ptr = va_arg(args, void*);
+    va_end(args);
+    assert(ptr != nullptr);
+
+    if (bytes > POOL_MAX_SIZE) {
+        osFree(ptr, alignPow2(bytes, osPageSize()));
+        return;
+    }
+
+    Pool* pool = (Pool*)allocator.data;
+    PoolSizeClass& size_class = pool->classes[poolSizeClass(bytes)];
+    *(void**)ptr = size_class.free_list;
+    size_class.free_list = ptr;
+}
+
+void poolFree(Allocator& allocator) {
+    assert(allocator.alloc == poolAlloc && allocator.data != nullptr);
+
+    Pool* pool = (Pool*)allocator.data;
+    PoolSlab* slab = pool->slabs;
+    while (slab != nullptr) {
+        PoolSlab* next = slab->next;
+        osFree(slab, slab->size);
+        slab = next;
+    }
+    free(pool);
+
+    allocator.alloc = nullptr;
+    allocator.dealloc = nullptr;
+    allocator.data = nullptr;
+}
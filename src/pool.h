@@ -0,0 +1,47 @@
+#pragma once
+
+#include "alloc.h"
+
+#include <stdint.h>
+
+
+// Smallest and largest block served from slabs, sizes in between are rounded
+// up to the next power of two, larger requests go straight to osAlloc
+#define POOL_MIN_SIZE 16
+#define POOL_MAX_SIZE 4096
+#define POOL_SIZE_CLASS_COUNT 9
+// Default bytes requested from osAlloc for each slab
+#define POOL_SLAB_SIZE (256ull << 10)
+
+// Header at the start of every slab, links all slabs of a pool for poolFree
+struct PoolSlab {
+    PoolSlab* next = nullptr;
+    uint64_t size = 0;
+};
+
+// Blocks of one size class, freed blocks are reused through an intrusive free
+// list before new ones are carved from the current slab
+struct PoolSizeClass {
+    void* free_list = nullptr;
+    uint8_t* cursor = nullptr;
+    uint8_t* end = nullptr;
+};
+
+// Allocates fixed size blocks from per size class slabs, any block can be
+// freed individually in O(1)
+struct Pool {
+    PoolSizeClass classes[POOL_SIZE_CLASS_COUNT];
+    PoolSlab* slabs = nullptr;
+    uint64_t slab_size = 0;
+};
+
+Allocator poolNew(uint64_t slab_bytes = POOL_SLAB_SIZE);
+// Impl of alloc for Pools, equivalent to alloc(pool_allocator, ...)
+void* poolAlloc(Allocator& allocator, uint64_t bytes, uint64_t alignment);
+#define poolAllocN(allocator, type, count) \
+    poolAlloc(allocator, sizeof(type)*count, alignof(type))
+// Impl of dealloc for Pools, bytes must match the size the block was
+// allocated with and the block is passed as the variadic argument
+void poolDealloc(Allocator& allocator, uint64_t bytes, ...);
+// Releases every slab, blocks larger than POOL_MAX_SIZE must be freed first
+void poolFree(Allocator& allocator);
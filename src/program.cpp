@@ -48,7 +48,10 @@ static void readShader(Shader& _shader, const uint32_t* _code,
     assert(_code[0] == SpvMagicNumber);
 
     uint32_t idBound = _code[3];
-    std::vector<Id> ids(idBound);
+
+    Scratch scratch;
+    Id* ids = (Id*)arenaPushN(scratch.allocator(), Id, idBound);
+    memset(ids, 0, sizeof(Id) * idBound);
 
     int localSizeIdX = -1;
     int localSizeIdY = -1;
@@ -153,7 +156,8 @@ static void readShader(Shader& _shader, const uint32_t* _code,
         instructK += wordCount;
     }
 
-    for (auto& id : ids) {
+    for (uint32_t i = 0; i < idBound; ++i) {
+        const Id& id = ids[i];
         if (id.opcode == SpvOpVariable &&
             (id.storageClass == SpvStorageClassUniform ||
                 id.storageClass == SpvStorageClassUniformConstant ||
@@ -221,7 +225,8 @@ static uint32_t gatherResources(Shaders _shaders,
 
 static VkDescriptorSetLayout createSetLayout(VkDevice _device,
     Shaders _shaders) {
-    std::vector<VkDescriptorSetLayoutBinding> setBindings;
+    Scratch scratch;
+    Vector<VkDescriptorSetLayoutBinding> setBindings(scratch.allocator(), 32);
 
     VkDescriptorType resourceTypes[32] = {};
     uint32_t resourceMask = gatherResources(_shaders, resourceTypes);
@@ -240,14 +245,14 @@ static VkDescriptorSetLayout createSetLayout(VkDevice _device,
                     binding.stageFlags |= shader->stage;
                 }
             }
-            setBindings.push_back(binding);
+            setBindings.push(binding);
         }
     }
     VkDescriptorSetLayoutCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
     createInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT;
-    createInfo.bindingCount = uint32_t(setBindings.size());
-    createInfo.pBindings = setBindings.data();
+    createInfo.bindingCount = uint32_t(setBindings.size);
+    createInfo.pBindings = setBindings.data;
 
     VkDescriptorSetLayout setLayout = 0;
     VK_CHECK(vkCreateDescriptorSetLayout(_device, &createInfo, nullptr, &setLayout));
@@ -279,7 +284,8 @@ static VkPipelineLayout createPipelineLayout(VkDevice _device, VkDescriptorSetLa
 }
 
 static VkDescriptorUpdateTemplate createUpdateTemplate(VkDevice _device, VkPipelineBindPoint _bindPoint, VkPipelineLayout _layout, Shaders _shaders, uint32_t* _pushDescriptorCount) {
-    std::vector<VkDescriptorUpdateTemplateEntry> entries;
+    Scratch scratch;
+    Vector<VkDescriptorUpdateTemplateEntry> entries(scratch.allocator(), 32);
 
     VkDescriptorType resourceTypes[32] = {};
     uint32_t resourceMask = gatherResources(_shaders, resourceTypes);
@@ -294,18 +300,18 @@ static VkDescriptorUpdateTemplate createUpdateTemplate(VkDevice _device, VkPipel
             entry.offset = sizeof(DescriptorInfo) * i;
             entry.stride = sizeof(DescriptorInfo);
 
-            entries.push_back(entry);
+            entries.push(entry);
         }
     }
 
     VkDescriptorUpdateTemplate updateTemplate = 0;
 
-    *_pushDescriptorCount = uint32_t(entries.size());
-    if(entries.size() > 0){   
+    *_pushDescriptorCount = uint32_t(entries.size);
+    if(entries.size > 0){   
         VkDescriptorUpdateTemplateCreateInfo createInfo{};
         createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
-        createInfo.descriptorUpdateEntryCount = uint32_t(entries.size())>0 ? uint32_t(entries.size()) : 1;
-        createInfo.pDescriptorUpdateEntries = entries.data();
+        createInfo.descriptorUpdateEntryCount = uint32_t(entries.size)>0 ? uint32_t(entries.size) : 1;
+        createInfo.pDescriptorUpdateEntries = entries.data;
         createInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_PUSH_DESCRIPTORS;
         createInfo.pipelineBindPoint = _bindPoint;
         createInfo.pipelineLayout = _layout;
@@ -318,21 +324,25 @@ static VkDescriptorUpdateTemplate createUpdateTemplate(VkDevice _device, VkPipel
 }
 
 
-bool loadShader(Shader& _shader, const std::string& filename) {
+bool loadShader(Shader& _shader, const char* filename) {
     std::ifstream file(filename, std::ios::ate | std::ios::binary);
 
     assert(file.is_open());
 
     size_t filesize = (size_t)file.tellg();
     assert(filesize >= 0);
-    std::vector<char> buffer(filesize);
+    assert(filesize % 4 == 0);
+
+    // Read into scratch so rejected modules never touch the heap, only the
+    // module that is kept is copied into the shader
+    Scratch scratch;
+    char* buffer = (char*)arenaPush(scratch.allocator(), filesize, alignof(uint32_t));
     file.seekg(0);
-    file.read(buffer.data(), filesize);
+    file.read(buffer, filesize);
     file.close();
-    assert(filesize % 4 == 0);
-    readShader(_shader, reinterpret_cast<const uint32_t*>(buffer.data()), filesize / 4);
+    readShader(_shader, reinterpret_cast<const uint32_t*>(buffer), filesize / 4);
 
-    _shader.spirvCode = buffer;
+    _shader.spirvCode.assign(buffer, buffer + filesize);
 
     return true;
 }
@@ -407,17 +417,26 @@ void destroyProgram(VkDevice _device, const Program& program) {
 
 bool loadShaders(ShaderSet& shaders, const char* base, const char* path)
 {
-	std::string spath = base;
-	std::string::size_type pos = spath.find_last_of("/\\");
-	if (pos == std::string::npos)
-		spath = "";
-	else
-		spath = spath.substr(0, pos + 1);
-	spath += path;
+	// Paths only live while their module is loaded, build them in scratch so
+	// the shader names are the only strings that reach the heap
+	Scratch scratch;
+
+	size_t baseLength = 0;
+	for (size_t i = 0; base[i]; i++)
+		if (base[i] == '/' || base[i] == '\\')
+			baseLength = i + 1;
+
+	size_t spathLength = baseLength + strlen(path);
+	char* spath = (char*)arenaPush(scratch.allocator(), spathLength + 1, 1);
+	memcpy(spath, base, baseLength);
+	memcpy(spath + baseLength, path, strlen(path) + 1);
     
     #ifdef _WIN32
+        char* pattern = (char*)arenaPush(scratch.allocator(), spathLength + sizeof("/*.spv"), 1);
+        snprintf(pattern, spathLength + sizeof("/*.spv"), "%s/*.spv", spath);
+
         _finddata_t finddata;
-        intptr_t fh = _findfirst((spath + "/*.spv").c_str(), &finddata);
+        intptr_t fh = _findfirst(pattern, &finddata);
         if (fh == -1)
             return false;
     
@@ -427,9 +446,15 @@ bool loadShaders(ShaderSet& shaders, const char* base, const char* path)
             if (!ext)
                 continue;
 
-            std::string fpath = spath + '/' + finddata.name;
+            ArenaTemp fileTemp = arenaTempBegin(scratch.allocator());
+            size_t fpathLength = spathLength + 1 + strlen(finddata.name) + 1;
+            char* fpath = (char*)arenaPush(scratch.allocator(), fpathLength, 1);
+            snprintf(fpath, fpathLength, "%s/%s", spath, finddata.name);
+
             Shader shader = {};
-            if (!loadShader(shader, fpath.c_str()))
+            bool loaded = loadShader(shader, fpath);
+            arenaTempEnd(fileTemp);
+            if (!loaded)
             {
                 fprintf(stderr, "Warning: %s is not a valid SPIRV module\n", finddata.name);
                 continue;
@@ -441,7 +466,7 @@ bool loadShaders(ShaderSet& shaders, const char* base, const char* path)
 
         _findclose(fh);
     #else
-	DIR* dir = opendir(spath.c_str());
+	DIR* dir = opendir(spath);
 	if (!dir)
 		return false;
 
@@ -451,9 +476,15 @@ bool loadShaders(ShaderSet& shaders, const char* base, const char* path)
 		if (!ext || strcmp(ext, ".spv") != 0)
 			continue;
 
-		std::string fpath = spath + '/' + de->d_name;
+		ArenaTemp fileTemp = arenaTempBegin(scratch.allocator());
+		size_t fpathLength = spathLength + 1 + strlen(de->d_name) + 1;
+		char* fpath = (char*)arenaPush(scratch.allocator(), fpathLength, 1);
+		snprintf(fpath, fpathLength, "%s/%s", spath, de->d_name);
+
 		Shader shader = {};
-		if (!loadShader(shader, fpath.c_str()))
+		bool loaded = loadShader(shader, fpath);
+		arenaTempEnd(fileTemp);
+		if (!loaded)
 		{
 			fprintf(stderr, "Warning: %s is not a valid SPIRV module\n", de->d_name);
 			continue;
@@ -466,7 +497,7 @@ bool loadShaders(ShaderSet& shaders, const char* base, const char* path)
 	closedir(dir);
     #endif
 
-	printf("Loaded %d shaders from %s\n", int(shaders.shaders.size()), spath.c_str());
+	printf("Loaded %d shaders from %s\n", int(shaders.shaders.size()), spath);
 	return true;
 }
 
@@ -530,7 +561,7 @@ VkDescriptorSetLayout createDescriptorArrayLayout(VkDevice _device) {
     return layout;
 }
 
-VkPipeline createGraphicsPipeline(VkDevice _device, VkPipelineCache _pipelineCache, const VkPipelineRenderingCreateInfo& _renderingInfo, const Program& _program, Constants constants) {
+VkPipeline createGraphicsPipeline(VkDevice _device, VkPipelineCache _pipelineCache, const VkPipelineRenderingCreateInfo& _renderingInfo, const Program& _program, Constants constants, VertexFormat _vertexFormat) {
     std::vector<VkSpecializationMapEntry> specializationEntries;
     VkSpecializationInfo specializationInfo = fillSpecializationInfo(specializationEntries, constants);
 
@@ -554,6 +585,10 @@ VkPipeline createGraphicsPipeline(VkDevice _device, VkPipelineCache _pipelineCac
 
     auto bindingDescription = Vertex::getBindingDescription();
     auto attributeDescriptions = Vertex::getAttributeDescriptions();
+    if (_vertexFormat == VertexFormat_Packed) {
+        bindingDescription = PackedVertex::getBindingDescription();
+        attributeDescriptions = PackedVertex::getAttributeDescriptions();
+    }
 
     VkPipelineVertexInputStateCreateInfo vertexInput{};
     vertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
@@ -43,6 +43,58 @@ struct Vertex{
         return pos == other.pos && color == other.color && texCoord == other.texCoord;
     }
 };
+// the dedup table in loadModel hashes and compares vertices as raw bytes
+static_assert(sizeof(Vertex) == 32, "Vertex must not contain padding");
+
+// Half the size of Vertex, built from it by packVertices. Positions are unorm16
+// within the mesh bounds and decoded with VertexDecode, the fourth lane holds
+// an octahedral normal as two snorm8
+struct PackedVertex{
+    uint16_t pos[4];
+    uint8_t color[4];
+    uint16_t texCoord[2]; // half floats
+
+    static VkVertexInputBindingDescription getBindingDescription(){
+        VkVertexInputBindingDescription bindingDescription{};
+        bindingDescription.binding = 0;
+        bindingDescription.stride = sizeof(PackedVertex);
+        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+        return bindingDescription;
+    }
+    static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions() {
+        std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions{};
+        attributeDescriptions[0].binding = 0;
+        attributeDescriptions[0].location = 0;
+        attributeDescriptions[0].format = VK_FORMAT_R16G16B16A16_UINT;
+        attributeDescriptions[0].offset = offsetof(PackedVertex, pos);
+
+        attributeDescriptions[1].binding = 0;
+        attributeDescriptions[1].location = 1;
+        attributeDescriptions[1].format = VK_FORMAT_R8G8B8A8_UNORM;
+        attributeDescriptions[1].offset = offsetof(PackedVertex, color);
+
+        attributeDescriptions[2].binding = 0;
+        attributeDescriptions[2].location = 2;
+        attributeDescriptions[2].format = VK_FORMAT_R16G16_SFLOAT;
+        attributeDescriptions[2].offset = offsetof(PackedVertex, texCoord);
+
+        return attributeDescriptions;
+    }
+};
+static_assert(sizeof(PackedVertex) == 16, "PackedVertex must not contain padding");
+
+// Push constants of the packed vertex shader, position = boundsMin + pos * scale
+struct VertexDecode{
+    glm::vec4 boundsMin;
+    glm::vec4 scale;
+};
+
+// Vertex layout a graphics pipeline reads
+enum VertexFormat {
+    VertexFormat_Full,
+    VertexFormat_Packed,
+};
 
 struct Shader {
     std::string name;
@@ -163,7 +215,7 @@ static VkDescriptorSetLayout createSetLayout(VkDevice _device, Shaders _shaders)
 static VkPipelineLayout createPipelineLayout(VkDevice _device, VkDescriptorSetLayout _setLayout, VkDescriptorSetLayout _arrayLayout, VkShaderStageFlags _pushConstantStages, size_t _pushConstantSize);
 static VkDescriptorUpdateTemplate createUpdateTemplate(VkDevice _device, VkPipelineBindPoint _bindPoint, VkPipelineLayout _layout, Shaders _shaders, uint32_t* _pushDescriptorCount);
 
-bool loadShader(Shader& _shader, const std::string& filename);
+bool loadShader(Shader& _shader, const char* filename);
 bool loadShaders(ShaderSet& _shaders, const char* base, const char* path);
 
 static VkSpecializationInfo fillSpecializationInfo(std::vector<VkSpecializationMapEntry>& entries, const Constants& constants);
@@ -176,4 +228,4 @@ std::pair<VkDescriptorPool, VkDescriptorSet> createDescriptorArray(VkDevice _dev
 
 VkDescriptorSetLayout createDescriptorArrayLayout(VkDevice _device);
 
-VkPipeline createGraphicsPipeline(VkDevice _device, VkPipelineCache _pipelineCache, const VkPipelineRenderingCreateInfo& _renderingInfo, const Program& _program, Constants constants);
\ No newline at end of file
+VkPipeline createGraphicsPipeline(VkDevice _device, VkPipelineCache _pipelineCache, const VkPipelineRenderingCreateInfo& _renderingInfo, const Program& _program, Constants constants, VertexFormat _vertexFormat = VertexFormat_Full);
\ No newline at end of file
@@ -0,0 +1,30 @@
+#version 450 
+
+// PackedVertex, xyz is unorm16 within the mesh bounds and w an octahedral normal
+layout(location = 0) in uvec4 inPosition;
+layout(location = 1) in vec4 inColor;
+layout(location = 2) in vec2 inTexCoord;
+
+layout(push_constant) uniform VertexDecode{
+    vec4 boundsMin;
+    vec4 scale;
+} decode;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec3 fragNormal;
+
+vec3 octDecode(vec2 e){
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+void main(){
+    vec3 position = decode.boundsMin.xyz + vec3(inPosition.xyz) * decode.scale.xyz;
+
+    gl_Position = vec4(position.xy, 0.0, 1.0);
+    fragColor = inColor.rgb;
+    fragNormal = octDecode(unpackSnorm4x8(inPosition.w).xy);
+}
@@ -0,0 +1,335 @@
+#include "tlsf.h"
+
+#include <stddef.h>
+
+
+#define TLSF_BLOCK_FREE 1ull
+#define TLSF_PREV_FREE 2ull
+#define TLSF_FLAG_MASK (TLSF_BLOCK_FREE | TLSF_PREV_FREE)
+
+// Only prev_phys and size are kept for a used block, the free list links
+// overlap the start of the payload
+internal const uint64_t TLSF_HEADER_SIZE = offsetof(TlsfBlock, next_free);
+// Smallest payload that can hold the free list links once freed
+internal const uint64_t TLSF_MIN_BLOCK_SIZE = sizeof(TlsfBlock) - offsetof(TlsfBlock, next_free);
+
+static_assert(TLSF_HEADER_SIZE % TLSF_ALIGN_SIZE == 0, "Tlsf payloads must stay aligned");
+static_assert(sizeof(TlsfPool) % TLSF_ALIGN_SIZE == 0, "Tlsf pools must keep blocks aligned");
+
+internal uint64_t blockSize(const TlsfBlock* block) {
+    return block->size & ~TLSF_FLAG_MASK;
+}
+
+internal void blockSetSize(TlsfBlock* block, uint64_t size) {
+    block->size = size | (block->size & TLSF_FLAG_MASK);
+}
+
+internal void* blockPayload(TlsfBlock* block) {
+    return (uint8_t*)block + TLSF_HEADER_SIZE;
+}
+
+internal TlsfBlock* blockFromPayload(void* ptr) {
+    return (TlsfBlock*)((uint8_t*)ptr - TLSF_HEADER_SIZE);
+}
+
+internal TlsfBlock* blockNext(TlsfBlock* block) {
+    return (TlsfBlock*)((uint8_t*)blockPayload(block) + blockSize(block));
+}
+
+// Marks a block free and lets its physical successor know
+internal void blockMarkFree(TlsfBlock* block) {
+    block->size |= TLSF_BLOCK_FREE;
+    blockNext(block)->size |= TLSF_PREV_FREE;
+}
+
+internal void blockMarkUsed(TlsfBlock* block) {
+    block->size &= ~TLSF_BLOCK_FREE;
+    blockNext(block)->size &= ~TLSF_PREV_FREE;
+}
+
+// Finds the free list a block of size belongs in
+internal void mappingInsert(uint64_t size, uint32_t& fl, uint32_t& sl) {
+    if (size < TLSF_SMALL_BLOCK_SIZE) {
+        fl = 0;
+        sl = (uint32_t)(size / (TLSF_SMALL_BLOCK_SIZE / TLSF_SL_INDEX_COUNT));
+    } else {
+        uint32_t msb = bitScanReverse(size);
+        sl = (uint32_t)(size >> (msb - TLSF_SL_INDEX_COUNT_LOG2)) ^ TLSF_SL_INDEX_COUNT;
+        fl = msb - (TLSF_FL_INDEX_SHIFT - 1);
+    }
+}
+
+// Finds the first free list whose every block is at least size, rounding size
+// up to the next list boundary
+internal void mappingSearch(uint64_t size, uint32_t& fl, uint32_t& sl) {
+    if (size >= TLSF_SMALL_BLOCK_SIZE) {
+        size += (1ull << (bitScanReverse(size) - TLSF_SL_INDEX_COUNT_LOG2)) - 1;
+    }
+    mappingInsert(size, fl, sl);
+}
+
+internal void insertFreeBlock(Tlsf* tlsf, TlsfBlock* block) {
+    uint32_t fl, sl;
+    mappingInsert(blockSize(block), fl, sl);
+
+    TlsfBlock* head = tlsf->blocks[fl][sl];
+    block->next_free = head;
+    block->prev_free = nullptr;
+    if (head != nullptr) {
+        head->prev_free = block;
+    }
+    tlsf->blocks[fl][sl] = block;
+
+    tlsf->fl_bitmap |= 1ull << fl;
+    tlsf->sl_bitmap[fl] |= 1ull << sl;
+}
+
+internal void removeFreeBlock(Tlsf* tlsf, TlsfBlock* block) {
+    uint32_t fl, sl;
+    mappingInsert(blockSize(block), fl, sl);
+
+    if (block->prev_free != nullptr) {
+        block->prev_free->next_free = block->next_free;
+    }
+    if (block->next_free != nullptr) {
+        block->next_free->prev_free = block->prev_free;
+    }
+
+    if (tlsf->blocks[fl][sl] == block) {
+        tlsf->blocks[fl][sl] = block->next_free;
+        if (block->next_free == nullptr) {
+            tlsf->sl_bitmap[fl] &= ~(1ull << sl);
+            if (tlsf->sl_bitmap[fl] == 0) {
+                tlsf->fl_bitmap &= ~(1ull << fl);
+            }
+        }
+    }
+}
+
+// Returns the head of the first non empty list at or above fl/sl, or null
+internal TlsfBlock* searchSuitableBlock(Tlsf* tlsf, uint32_t fl, uint32_t sl) {
+    if (fl >= TLSF_FL_INDEX_COUNT) {
+        return nullptr;
+    }
+
+    uint64_t sl_map = tlsf->sl_bitmap[fl] & (~0ull << sl);
+    if (sl_map == 0) {
+        uint64_t fl_map = tlsf->fl_bitmap & (~0ull << (fl + 1));
+        if (fl_map == 0) {
+            return nullptr;
+        }
+
+        fl = bitScanForward(fl_map);
+        sl_map = tlsf->sl_bitmap[fl];
+    }
+    sl = bitScanForward(sl_map);
+
+    return tlsf->blocks[fl][sl];
+}
+
+// Splits the tail past size off a free block that is not in any list, the
+// tail goes back into the free lists
+internal void trimFreeBlock(Tlsf* tlsf, TlsfBlock* block, uint64_t size) {
+    if (blockSize(block) < size + TLSF_HEADER_SIZE + TLSF_MIN_BLOCK_SIZE) {
+        return;
+    }
+
+    TlsfBlock* remaining = (TlsfBlock*)((uint8_t*)blockPayload(block) + size);
+    remaining->size = 0;
+    blockSetSize(remaining, blockSize(block) - size - TLSF_HEADER_SIZE);
+    remaining->prev_phys = block;
+    blockNext(remaining)->prev_phys = remaining;
+    blockSetSize(block, size);
+
+    blockMarkFree(remaining);
+    insertFreeBlock(tlsf, remaining);
+}
+
+// Maps another pool large enough to hold a block of size with the given
+// alignment gap, laid out as one free block followed by a used sentinel
+internal void tlsfGrow(Tlsf* tlsf, uint64_t size) {
+    uint64_t overhead = sizeof(TlsfPool) + 2 * TLSF_HEADER_SIZE;
+    uint64_t pool_bytes = tlsf->pool_size;
+    if (size + overhead > pool_bytes) {
+        pool_bytes = size + overhead;
+    }
+    assert(pool_bytes - overhead < (1ull << TLSF_FL_INDEX_MAX));
+
+    VirtualMemoryBlock memory = osAlloc(pool_bytes);
+    TlsfPool* pool = (TlsfPool*)memory.memory;
+    pool->next = tlsf->pools;
+    pool->size = memory.size;
+    tlsf->pools = pool;
+    tlsf->stats.pool_bytes += memory.size;
+
+    uint64_t block_size = (memory.size - overhead) & ~(uint64_t)(TLSF_ALIGN_SIZE - 1);
+    TlsfBlock* block = (TlsfBlock*)((uint8_t*)memory.memory + sizeof(TlsfPool));
+    block->prev_phys = nullptr;
+    block->size = block_size;
+
+    // Zero sized used block that stops merges from running off the pool
+    TlsfBlock* sentinel = blockNext(block);
+    sentinel->prev_phys = block;
+    sentinel->size = 0;
+
+    blockMarkFree(block);
+    insertFreeBlock(tlsf, block);
+}
+
+Allocator tlsfNew(uint64_t pool_bytes) {
+    assert(pool_bytes > 0);
+
+    Tlsf* tlsf = (Tlsf*)calloc(1, sizeof(Tlsf));
+    if (tlsf == nullptr) {
+        printf("Error, failed to allocate tlsf allocator members\n");
+        exit(-1);
+    }
+
+    tlsf->pool_size = pool_bytes;
+    tlsfGrow(tlsf, 0);
+
+    return {
+        .alloc = tlsfAlloc,
+        .dealloc = tlsfDealloc,
+        .data = tlsf
+    };
+}
+
+void* tlsfAlloc(Allocator& allocator, uint64_t bytes, uint64_t alignment) {
+    assert(allocator.data != nullptr && bytes > 0);
+
+    Tlsf* tlsf = (Tlsf*)allocator.data;
+    uint64_t size = alignPow2(bytes, TLSF_ALIGN_SIZE);
+    if (size < TLSF_MIN_BLOCK_SIZE) {
+        size = TLSF_MIN_BLOCK_SIZE;
+    }
+
+    // Over aligned requests search for enough room to split off a leading
+    // free block that moves the payload onto the alignment
+    uint64_t search_size = size;
+    if (alignment > TLSF_ALIGN_SIZE) {
+        search_size += alignment + TLSF_HEADER_SIZE + TLSF_MIN_BLOCK_SIZE;
+    }
+
+    uint32_t fl, sl;
+    mappingSearch(search_size, fl, sl);
+    TlsfBlock* block = searchSuitableBlock(tlsf, fl, sl);
+    if (block == nullptr) {
+        // Grow by enough that the rounded up list search is satisfied
+        tlsfGrow(tlsf, search_size + (search_size >> TLSF_SL_INDEX_COUNT_LOG2));
+        mappingSearch(search_size, fl, sl);
+        block = searchSuitableBlock(tlsf, fl, sl);
+        assert(block != nullptr);
+    }
+    removeFreeBlock(tlsf, block);
+
+    if (alignment > TLSF_ALIGN_SIZE) {
+        uintptr_t payload = (uintptr_t)blockPayload(block);
+        uintptr_t aligned = alignPow2(payload, alignment);
+        // The leading gap must be able to stand as a free block of its own
+        if (aligned != payload && aligned - payload < TLSF_HEADER_SIZE + TLSF_MIN_BLOCK_SIZE) {
+            aligned = alignPow2(payload + TLSF_HEADER_SIZE + TLSF_MIN_BLOCK_SIZE, alignment);
+        }
+
+        if (aligned != payload) {
+            uint64_t gap = aligned - payload;
+            TlsfBlock* aligned_block = blockFromPayload((void*)aligned);
+            aligned_block->size = 0;
+            blockSetSize(aligned_block, blockSize(block) - gap);
+            aligned_block->prev_phys = block;
+            blockNext(aligned_block)->prev_phys = aligned_block;
+
+            blockSetSize(block, gap - TLSF_HEADER_SIZE);
+            insertFreeBlock(tlsf, block);
+            block = aligned_block;
+            block->size |= TLSF_PREV_FREE;
+        }
+    }
+
+    trimFreeBlock(tlsf, block, size);
+    blockMarkUsed(block);
+
+    tlsf->stats.bytes_in_use += blockSize(block);
+    if (tlsf->stats.bytes_in_use > tlsf->stats.peak_bytes_in_use) {
+        tlsf->stats.peak_bytes_in_use = tlsf->stats.bytes_in_use;
+    }
+    tlsf->stats.alloc_count++;
+
+    return blockPayload(block);
+}
+
+void tlsfDealloc(Allocator& allocator, uint64_t bytes, ...) {
+    assert(allocator.data != nullptr);
+
+    va_list args;
+    va_start(args, bytes);
+    void* ptr = va_arg(args, void*);
+    va_end(args);
+    assert(ptr != nullptr);
+
+    Tlsf* tlsf = (Tlsf*)allocator.data;
+    TlsfBlock* block = blockFromPayload(ptr);
+    assert((block->size & TLSF_BLOCK_FREE) == 0);
+
+    tlsf->stats.bytes_in_use -= blockSize(block);
+    tlsf->stats.free_count++;
+
+    // Merge with free physical neighbours so fragmentation stays bounded
+    if (block->size & TLSF_PREV_FREE) {
+        TlsfBlock* prev = block->prev_phys;
+        removeFreeBlock(tlsf, prev);
+        blockSetSize(prev, blockSize(prev) + TLSF_HEADER_SIZE + blockSize(block));
+        blockNext(prev)->prev_phys = prev;
+        block = prev;
+    }
+
+    TlsfBlock* next = blockNext(block);
+    if (next->size & TLSF_BLOCK_FREE) {
+        removeFreeBlock(tlsf, next);
+        blockSetSize(block, blockSize(block) + TLSF_HEADER_SIZE + blockSize(next));
+        blockNext(block)->prev_phys = block;
+    }
+
+    blockMarkFree(block);
+    insertFreeBlock(tlsf, block);
+}
+
+TlsfStats tlsfStats(Allocator& allocator) {
+    assert(allocator.alloc == tlsfAlloc && allocator.data != nullptr);
+
+    Tlsf* tlsf = (Tlsf*)allocator.data;
+    TlsfStats stats = tlsf->stats;
+    stats.free_bytes = 0;
+    stats.largest_free_block = 0;
+
+    for (uint32_t fl = 0; fl < TLSF_FL_INDEX_COUNT; fl++) {
+        for (uint32_t sl = 0; sl < TLSF_SL_INDEX_COUNT; sl++) {
+            for (TlsfBlock* block = tlsf->blocks[fl][sl]; block != nullptr; block = block->next_free) {
+                uint64_t size = blockSize(block);
+                stats.free_bytes += size;
+                if (size > stats.largest_free_block) {
+                    stats.largest_free_block = size;
+                }
+            }
+        }
+    }
+
+    return stats;
+}
+
+void tlsfFree(Allocator& allocator) {
+    assert(allocator.alloc == tlsfAlloc && allocator.data != nullptr);
+
+    Tlsf* tlsf = (Tlsf*)allocator.data;
+    TlsfPool* pool = tlsf->pools;
+    while (pool != nullptr) {
+        TlsfPool* next = pool->next;
+        osFree(pool, pool->size);
+        pool = next;
+    }
+    free(tlsf);
+
+    allocator.alloc = nullptr;
+    allocator.dealloc = nullptr;
+    allocator.data = nullptr;
+}
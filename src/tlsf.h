@@ -0,0 +1,73 @@
+#pragma once
+
+#include "alloc.h"
+
+#include <stdint.h>
+
+
+// Blocks are aligned to and sized in multiples of 16 bytes
+#define TLSF_ALIGN_SIZE 16
+// Each first level size range is split into 32 linearly spaced second level lists
+#define TLSF_SL_INDEX_COUNT_LOG2 5
+#define TLSF_SL_INDEX_COUNT (1 << TLSF_SL_INDEX_COUNT_LOG2)
+// Blocks smaller than this share first level 0, sized in TLSF_ALIGN_SIZE steps
+#define TLSF_FL_INDEX_SHIFT 9
+#define TLSF_SMALL_BLOCK_SIZE (1ull << TLSF_FL_INDEX_SHIFT)
+// Largest block is just under 1 << TLSF_FL_INDEX_MAX bytes
+#define TLSF_FL_INDEX_MAX 40
+#define TLSF_FL_INDEX_COUNT (TLSF_FL_INDEX_MAX - TLSF_FL_INDEX_SHIFT + 1)
+// Default bytes requested from osAlloc each time a Tlsf runs out of memory
+#define TLSF_POOL_SIZE (64ull << 20)
+
+// Header in front of every block, a free block also stores its free list links
+// at the start of its payload
+struct TlsfBlock {
+    // Physically preceding block in the same pool, null for the first block
+    TlsfBlock* prev_phys = nullptr;
+    // Payload bytes, the low bits hold the free flags of this and the
+    // preceding block
+    uint64_t size = 0;
+    TlsfBlock* next_free = nullptr;
+    TlsfBlock* prev_free = nullptr;
+};
+
+// Header at the start of every OS block, links all pools of a Tlsf for tlsfFree
+struct TlsfPool {
+    TlsfPool* next = nullptr;
+    uint64_t size = 0;
+};
+
+struct TlsfStats {
+    // Payload bytes handed out, including rounding to TLSF_ALIGN_SIZE
+    uint64_t bytes_in_use = 0;
+    uint64_t peak_bytes_in_use = 0;
+    // Bytes mapped from the OS across all pools
+    uint64_t pool_bytes = 0;
+    uint64_t alloc_count = 0;
+    uint64_t free_count = 0;
+    // Filled by tlsfStats by walking the free lists
+    uint64_t free_bytes = 0;
+    uint64_t largest_free_block = 0;
+};
+
+// Two level segregated fit allocator, finds a free block of a good fit in O(1)
+// through a bitmap per level and merges neighbours on free in O(1)
+struct Tlsf {
+    uint64_t fl_bitmap = 0;
+    uint64_t sl_bitmap[TLSF_FL_INDEX_COUNT] = {};
+    TlsfBlock* blocks[TLSF_FL_INDEX_COUNT][TLSF_SL_INDEX_COUNT] = {};
+    TlsfPool* pools = nullptr;
+    uint64_t pool_size = 0;
+    TlsfStats stats;
+};
+
+Allocator tlsfNew(uint64_t pool_bytes = TLSF_POOL_SIZE);
+// Impl of alloc for Tlsfs, equivalent to alloc(tlsf_allocator, ...)
+void* tlsfAlloc(Allocator& allocator, uint64_t bytes, uint64_t alignment);
+// Impl of dealloc for Tlsfs, the block is passed as the variadic argument
+void tlsfDealloc(Allocator& allocator, uint64_t bytes, ...);
+// Returns the running statistics along with the current free space, the
+// fragmentation of a Tlsf is 1 - largest_free_block / free_bytes
+TlsfStats tlsfStats(Allocator& allocator);
+// Releases every pool, invalidates all blocks allocated from the Tlsf
+void tlsfFree(Allocator& allocator);
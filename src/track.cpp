@@ -0,0 +1,254 @@
+#include "track.h"
+#include "arena.h"
+#include "pool.h"
+#include "tlsf.h"
+
+
+internal TrackedAllocator* tracked_allocators = nullptr;
+internal thread_local const char* call_site = nullptr;
+
+Allocator trackNew(Allocator inner, const char* name) {
+    assert(inner.alloc != nullptr && inner.data != nullptr);
+
+    TrackedAllocator* tracker = (TrackedAllocator*)calloc(1, sizeof(TrackedAllocator));
+    if (tracker == nullptr) {
+        printf("Error, failed to allocate tracked allocator members\n");
+        exit(-1);
+    }
+
+    tracker->inner = inner;
+    tracker->name = name;
+    tracker->next = tracked_allocators;
+    tracked_allocators = tracker;
+
+    return {
+        .alloc = trackAlloc,
+        .dealloc = trackDealloc,
+        .data = tracker
+    };
+}
+
+internal TrackTag& findTag(TrackedAllocator* tracker, const char* site) {
+    if (site == nullptr) {
+        return tracker->untagged;
+    }
+
+    // Sites are string literals, so their address identifies them
+    uint64_t start = ((uintptr_t)site >> 3) % TRACK_TAG_COUNT;
+    for (uint64_t i = 0; i < TRACK_TAG_COUNT; i++) {
+        TrackTag& tag = tracker->tags[(start + i) % TRACK_TAG_COUNT];
+        if (tag.site == site) {
+            return tag;
+        }
+        if (tag.site == nullptr) {
+            tag.site = site;
+            return tag;
+        }
+    }
+
+    return tracker->untagged;
+}
+
+// Fills the usage the wrapped allocator itself reports
+internal void innerUsage(Allocator& inner, TrackSnapshot& snapshot) {
+    snapshot.inner_used = snapshot.bytes_in_use;
+    snapshot.capacity = 0;
+
+    if (inner.alloc == arenaPush) {
+        snapshot.inner_used = ((Arena*)inner.data)->last;
+        snapshot.capacity = ((Arena*)inner.data)->size;
+    } else if (inner.alloc == tlsfAlloc) {
+        snapshot.inner_used = ((Tlsf*)inner.data)->stats.bytes_in_use;
+        snapshot.capacity = ((Tlsf*)inner.data)->stats.pool_bytes;
+    } else if (inner.alloc == poolAlloc) {
+        for (PoolSlab* slab = ((Pool*)inner.data)->slabs; slab != nullptr; slab = slab->next) {
+            snapshot.capacity += slab->size;
+        }
+    }
+}
+
+void* trackAlloc(Allocator& allocator, uint64_t bytes, uint64_t alignment) {
+    assert(allocator.data != nullptr);
+
+    TrackedAllocator* tracker = (TrackedAllocator*)allocator.data;
+    const char* site = call_site;
+    call_site = nullptr;
+
+    // Arenas also pad their offset, measure what the push really consumed
+    uint64_t consumed = alignPow2(bytes, alignment);
+    void* ptr = nullptr;
+    if (tracker->inner.alloc == arenaPush) {
+        Arena* arena = (Arena*)tracker->inner.data;
+        uint64_t last = arena->last;
+        ptr = alloc(tracker->inner, bytes, alignment);
+        consumed = arena->last - last;
+    } else {
+        ptr = alloc(tracker->inner, bytes, alignment);
+    }
+
+    TrackSnapshot& current = tracker->current;
+    current.bytes_in_use += bytes;
+    if (current.bytes_in_use > current.peak_bytes_in_use) {
+        current.peak_bytes_in_use = current.bytes_in_use;
+    }
+    current.alloc_count++;
+    current.alignment_waste += consumed - bytes;
+
+    TrackTag& tag = findTag(tracker, site);
+    tag.bytes += bytes;
+    tag.count++;
+
+    return ptr;
+}
+
+void trackDealloc(Allocator& allocator, uint64_t bytes, ...) {
+    assert(allocator.data != nullptr);
+
+    va_list args;
+    va_start(args, bytes);
+    void* ptr = va_arg(args, void*);
+    va_end(args);
+
+    TrackedAllocator* tracker = (TrackedAllocator*)allocator.data;
+    dealloc(tracker->inner, bytes, ptr);
+
+    TrackSnapshot& current = tracker->current;
+    current.bytes_in_use = current.bytes_in_use > bytes ? current.bytes_in_use - bytes : 0;
+    current.free_count++;
+}
+
+void trackSetCallSite(const char* site) {
+    call_site = site;
+}
+
+void* trackAllocAt(Allocator& allocator, uint64_t bytes, uint64_t alignment, const char* site) {
+    call_site = site;
+    void* ptr = alloc(allocator, bytes, alignment);
+    call_site = nullptr;
+    return ptr;
+}
+
+Allocator& trackInner(Allocator& allocator) {
+    assert(allocator.alloc == trackAlloc && allocator.data != nullptr);
+
+    return ((TrackedAllocator*)allocator.data)->inner;
+}
+
+void trackReset(Allocator& allocator) {
+    assert(allocator.alloc == trackAlloc && allocator.data != nullptr);
+
+    TrackedAllocator* tracker = (TrackedAllocator*)allocator.data;
+    tracker->current.bytes_in_use = 0;
+    for (TrackTag& tag : tracker->tags) {
+        tag = {};
+    }
+    tracker->untagged = {};
+}
+
+TrackSnapshot trackSnapshot(Allocator& allocator) {
+    assert(allocator.alloc == trackAlloc && allocator.data != nullptr);
+
+    TrackedAllocator* tracker = (TrackedAllocator*)allocator.data;
+    TrackSnapshot snapshot = tracker->current;
+    innerUsage(tracker->inner, snapshot);
+    return snapshot;
+}
+
+void trackFrame(uint64_t frame) {
+    for (TrackedAllocator* tracker = tracked_allocators; tracker != nullptr; tracker = tracker->next) {
+        TrackSnapshot& snapshot = tracker->history[tracker->history_count % TRACK_SNAPSHOT_COUNT];
+        snapshot = tracker->current;
+        snapshot.frame = frame;
+        innerUsage(tracker->inner, snapshot);
+        tracker->history_count++;
+    }
+}
+
+internal void writeSnapshotJson(FILE* file, const TrackSnapshot& snapshot) {
+    fprintf(file, "{\"frame\": %llu, \"bytes_in_use\": %llu, \"peak_bytes_in_use\": %llu, "
+        "\"alloc_count\": %llu, \"free_count\": %llu, \"alignment_waste\": %llu, \"inner_used\": %llu, "
+        "\"capacity\": %llu}",
+        (unsigned long long)snapshot.frame, (unsigned long long)snapshot.bytes_in_use,
+        (unsigned long long)snapshot.peak_bytes_in_use, (unsigned long long)snapshot.alloc_count,
+        (unsigned long long)snapshot.free_count, (unsigned long long)snapshot.alignment_waste,
+        (unsigned long long)snapshot.inner_used, (unsigned long long)snapshot.capacity);
+}
+
+internal void writeTagJson(FILE* file, const TrackTag& tag, const char* site) {
+    fprintf(file, "{\"site\": \"");
+    // Windows paths carry backslashes that must be escaped
+    for (const char* c = site; *c; c++) {
+        if (*c == '\\' || *c == '"') {
+            fputc('\\', file);
+        }
+        fputc(*c, file);
+    }
+    fprintf(file, "\", \"bytes\": %llu, \"count\": %llu}", (unsigned long long)tag.bytes,
+        (unsigned long long)tag.count);
+}
+
+bool trackDumpJson(const char* path) {
+    FILE* file = fopen(path, "w");
+    if (file == nullptr) {
+        printf("Error, failed to open %s for the allocation report\n", path);
+        return false;
+    }
+
+    fprintf(file, "[\n");
+    for (TrackedAllocator* tracker = tracked_allocators; tracker != nullptr; tracker = tracker->next) {
+        TrackSnapshot current = tracker->current;
+        innerUsage(tracker->inner, current);
+
+        fprintf(file, "  {\"name\": \"%s\",\n   \"current\": ", tracker->name ? tracker->name : "");
+        writeSnapshotJson(file, current);
+
+        fprintf(file, ",\n   \"history\": [");
+        uint64_t count = tracker->history_count < TRACK_SNAPSHOT_COUNT ? tracker->history_count : TRACK_SNAPSHOT_COUNT;
+        for (uint64_t i = 0; i < count; i++) {
+            // Oldest first
+            uint64_t index = (tracker->history_count - count + i) % TRACK_SNAPSHOT_COUNT;
+            fprintf(file, i == 0 ? "\n     " : ",\n     ");
+            writeSnapshotJson(file, tracker->history[index]);
+        }
+
+        fprintf(file, "],\n   \"sites\": [");
+        bool first = true;
+        for (const TrackTag& tag : tracker->tags) {
+            if (tag.site == nullptr) {
+                continue;
+            }
+            fprintf(file, first ? "\n     " : ",\n     ");
+            writeTagJson(file, tag, tag.site);
+            first = false;
+        }
+        if (tracker->untagged.count > 0) {
+            fprintf(file, first ? "\n     " : ",\n     ");
+            writeTagJson(file, tracker->untagged, "untagged");
+        }
+
+        fprintf(file, "]}%s\n", tracker->next ? "," : "");
+    }
+    fprintf(file, "]\n");
+
+    fclose(file);
+    return true;
+}
+
+Allocator trackFree(Allocator& allocator) {
+    assert(allocator.alloc == trackAlloc && allocator.data != nullptr);
+
+    TrackedAllocator* tracker = (TrackedAllocator*)allocator.data;
+    TrackedAllocator** link = &tracked_allocators;
+    while (*link != tracker) {
+        link = &(*link)->next;
+    }
+    *link = tracker->next;
+
+    Allocator inner = tracker->inner;
+    free(tracker);
+
+    allocator.alloc = nullptr;
+    allocator.dealloc = nullptr;
+    allocator.data = nullptr;
+    return inner;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "alloc.h"
+
+#include <stdint.h>
+
+
+#define TRACK_TAG_COUNT 64
+#define TRACK_SNAPSHOT_COUNT 256
+
+#define TRACK_STRINGIFY_(x) #x
+#define TRACK_STRINGIFY(x) TRACK_STRINGIFY_(x)
+// Allocates through any allocator, tagging the allocation with its call site
+// when the allocator is tracked
+#define allocTagged(allocator, bytes, alignment) \
+    trackAllocAt(allocator, bytes, alignment, __FILE__ ":" TRACK_STRINGIFY(__LINE__))
+
+// Bytes and number of allocations made from one call site since the tracked
+// allocator was created or reset
+struct TrackTag {
+    const char* site = nullptr;
+    uint64_t bytes = 0;
+    uint64_t count = 0;
+};
+
+struct TrackSnapshot {
+    uint64_t frame = 0;
+    // Requested bytes of the live allocations
+    uint64_t bytes_in_use = 0;
+    uint64_t peak_bytes_in_use = 0;
+    uint64_t alloc_count = 0;
+    uint64_t free_count = 0;
+    // Bytes lost to rounding sizes and offsets up to the requested alignment
+    uint64_t alignment_waste = 0;
+    // Bytes the wrapped allocator reports as consumed including padding and
+    // block rounding, the last offset of an arena
+    uint64_t inner_used = 0;
+    // Bytes the wrapped allocator can hand out before growing or overflowing,
+    // the size of an arena or the mapped pools of a pool or tlsf
+    uint64_t capacity = 0;
+};
+
+// Wraps another allocator and records its usage, every tracked allocator is
+// registered so trackDumpJson can report all of them
+struct TrackedAllocator {
+    Allocator inner;
+    const char* name = nullptr;
+    TrackSnapshot current;
+    // Ring of per frame snapshots, history_count keeps counting past the ring
+    TrackSnapshot history[TRACK_SNAPSHOT_COUNT];
+    uint64_t history_count = 0;
+    TrackTag tags[TRACK_TAG_COUNT];
+    // Allocations without a call site or whose site did not fit in tags
+    TrackTag untagged;
+    TrackedAllocator* next = nullptr;
+};
+
+// Takes ownership of inner, which must not be used directly afterwards
+Allocator trackNew(Allocator inner, const char* name);
+// Impl of alloc for TrackedAllocators, equivalent to alloc(tracked_allocator, ...)
+void* trackAlloc(Allocator& allocator, uint64_t bytes, uint64_t alignment);
+// Impl of dealloc for TrackedAllocators, forwards the block to the inner allocator
+void trackDealloc(Allocator& allocator, uint64_t bytes, ...);
+// Tags the next allocation made on the calling thread, site must outlive the tracker
+void trackSetCallSite(const char* site);
+// Allocates through any allocator tagged with site, the site is cleared
+// afterwards even when the allocator is not tracked
+void* trackAllocAt(Allocator& allocator, uint64_t bytes, uint64_t alignment, const char* site);
+// Returns the wrapped allocator for allocator specific calls such as arenaReset,
+// call trackReset alongside them to keep the counters in sync
+Allocator& trackInner(Allocator& allocator);
+// Zeroes bytes in use and the call site tags, for after the inner allocator
+// was reset
+void trackReset(Allocator& allocator);
+TrackSnapshot trackSnapshot(Allocator& allocator);
+// Records the current counters of every tracked allocator into its history
+void trackFrame(uint64_t frame);
+// Writes every tracked allocator with its counters, history and call sites
+bool trackDumpJson(const char* path);
+// Unregisters the tracker and frees it, returns the inner allocator
+Allocator trackFree(Allocator& allocator);
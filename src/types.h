@@ -1,23 +1,281 @@
 #pragma once
 
+#include <string.h>
+#include <type_traits>
+
 #include "alloc.h"
+#include "arena.h"
 
 
+// Growable array of trivially copyable elements backed by an Allocator. When
+// the array sits at the top of an arena it grows in place, otherwise it moves
+// to a block twice the size
 template <typename T>
 class Vector {
+    static_assert(std::is_trivially_copyable_v<T>, "Vector relocates elements with memcpy");
+
     public:
-        T* data;
-        uint64_t size;
+        T* data = nullptr;
+        uint64_t size = 0;
+        uint64_t capacity = 0;
+        Allocator* allocator = nullptr;
 
         Vector() = delete;
-        Vector(Allocator& allocator, uint64_t size, uint64_t alignment = 1):
-            data(alloc(allocator, size, alignment)), size(alignPow2(size, alignment)) {}
+        Vector(Allocator& allocator, uint64_t capacity = 0): allocator(&allocator) {
+            reserve(capacity);
+        }
         T& operator[](uint64_t i) {
-            if (i > size) {
+            if (i >= size) {
+                printf("Error, Vector access out of bounds\n");
+                exit(-1);
+            }
+
+            return data[i];
+        }
+        const T& operator[](uint64_t i) const {
+            if (i >= size) {
                 printf("Error, Vector access out of bounds\n");
                 exit(-1);
             }
 
             return data[i];
         }
+
+        T* begin() { return data; }
+        T* end() { return data + size; }
+        const T* begin() const { return data; }
+        const T* end() const { return data + size; }
+
+        void push(const T& value) {
+            if (size == capacity) {
+                reserve(capacity ? capacity * 2 : 16);
+            }
+            data[size++] = value;
+        }
+        // Grows capacity to at least new_capacity, never shrinks
+        void reserve(uint64_t new_capacity) {
+            if (new_capacity <= capacity) {
+                return;
+            }
+
+            Arena* arena = arenaOf(*allocator);
+            if (arena != nullptr && data != nullptr &&
+                (uintptr_t)arena->memory + arena->last == (uintptr_t)(data + capacity)) {
+                // Nothing was pushed after the array, extend it where it is
+                alloc(*allocator, (new_capacity - capacity) * sizeof(T), alignof(T));
+                capacity = new_capacity;
+                return;
+            }
+
+            T* old = data;
+            data = (T*)alloc(*allocator, new_capacity * sizeof(T), alignof(T));
+            if (old != nullptr) {
+                memcpy(data, old, size * sizeof(T));
+                // Arenas only free from the top, the old block stays until reset
+                if (arena == nullptr) {
+                    dealloc(*allocator, capacity * sizeof(T), old);
+                }
+            }
+            capacity = new_capacity;
+        }
+        // Inserts value before index, shifting the elements after it
+        void insert(uint64_t index, const T& value) {
+            if (index > size) {
+                printf("Error, Vector insert out of bounds\n");
+                exit(-1);
+            }
+
+            if (size == capacity) {
+                reserve(capacity ? capacity * 2 : 16);
+            }
+            memmove(data + index + 1, data + index, (size - index) * sizeof(T));
+            data[index] = value;
+            size++;
+        }
+        // Removes the element at index, keeping the order of the rest
+        void remove(uint64_t index) {
+            if (index >= size) {
+                printf("Error, Vector remove out of bounds\n");
+                exit(-1);
+            }
+
+            memmove(data + index, data + index + 1, (size - index - 1) * sizeof(T));
+            size--;
+        }
+        void resize(uint64_t new_size) {
+            reserve(new_size);
+            size = new_size;
+        }
+        void clear() {
+            size = 0;
+        }
+};
+
+// Hashes the raw bytes of a value. 32 byte stripes feed four independent
+// lanes so the multiplies overlap and vectorize, the rest goes 8 bytes at a time
+inline uint64_t hashBytes(const void* data, uint64_t bytes) {
+    const uint8_t* bytes_ = (const uint8_t*)data;
+    uint64_t hash = 0x9e3779b97f4a7c15ull ^ bytes;
+
+    uint64_t i = 0;
+    if (bytes >= 32) {
+        uint64_t lanes[4] = {hash, hash + 0x6a09e667f3bcc909ull, hash + 0xbb67ae8584caa73bull, hash + 0x3c6ef372fe94f82bull};
+        for (; i + 32 <= bytes; i += 32) {
+            for (int lane = 0; lane < 4; lane++) {
+                uint64_t word;
+                memcpy(&word, bytes_ + i + lane * 8, 8);
+                lanes[lane] = (lanes[lane] ^ word) * 0xff51afd7ed558ccdull;
+                lanes[lane] ^= lanes[lane] >> 32;
+            }
+        }
+        hash = lanes[0] ^ (lanes[1] << 16 | lanes[1] >> 48) ^ (lanes[2] << 32 | lanes[2] >> 32) ^ (lanes[3] << 48 | lanes[3] >> 16);
+    }
+    for (; i + 8 <= bytes; i += 8) {
+        uint64_t word;
+        memcpy(&word, bytes_ + i, 8);
+        hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+        hash ^= hash >> 32;
+    }
+    if (i < bytes) {
+        uint64_t word = 0;
+        memcpy(&word, bytes_ + i, bytes - i);
+        hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+    }
+
+    hash ^= hash >> 29;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+template <typename K>
+struct BytesHash {
+    uint64_t operator()(const K& key) const {
+        return hashBytes(&key, sizeof(K));
+    }
+};
+
+// Bytewise equality to go with BytesHash, unlike float == it keeps -0 apart
+// from 0 and finds NaNs, so equal keys always hash the same
+template <typename K>
+struct BytesEqual {
+    bool operator()(const K& a, const K& b) const {
+        return memcmp(&a, &b, sizeof(K)) == 0;
+    }
+};
+
+// Open addressing hash map with linear probing, keys and values live in
+// separate arrays. Probing walks a byte per slot holding 7 bits of the hash,
+// keys are only compared on a matching tag. Keys are hashed with Hash and
+// compared with Equal, which default to their bytes
+template <typename K, typename V, typename Hash = BytesHash<K>, typename Equal = BytesEqual<K>>
+class HashMap {
+    static_assert(std::is_trivially_copyable_v<K> && std::is_trivially_copyable_v<V>,
+        "HashMap relocates entries with memcpy");
+
+    public:
+        K* keys = nullptr;
+        V* values = nullptr;
+        // 0 for empty slots, the tag of the entry otherwise
+        uint8_t* used = nullptr;
+        uint64_t size = 0;
+        // Always a power of two
+        uint64_t capacity = 0;
+        Allocator* allocator = nullptr;
+
+        HashMap() = delete;
+        // Sized so count entries fit without growing
+        HashMap(Allocator& allocator, uint64_t count = 0): allocator(&allocator) {
+            reserve(count);
+        }
+
+        V* find(const K& key) {
+            if (size == 0) {
+                return nullptr;
+            }
+
+            uint64_t hash = Hash{}(key);
+            uint8_t tag = tagOf(hash);
+            uint64_t mask = capacity - 1;
+            for (uint64_t i = hash & mask; used[i]; i = (i + 1) & mask) {
+                if (used[i] == tag && Equal{}(keys[i], key)) {
+                    return &values[i];
+                }
+            }
+            return nullptr;
+        }
+        // Returns the value of key, inserting value first if key is missing,
+        // one probe sequence for both the lookup and the insert
+        V& findOrInsert(const K& key, const V& value, bool* inserted = nullptr) {
+            // Keep the load factor at or below 3/4, doubling the capacity
+            if ((size + 1) * 4 > capacity * 3) {
+                reserve(capacity);
+            }
+
+            uint64_t hash = Hash{}(key);
+            uint8_t tag = tagOf(hash);
+            uint64_t mask = capacity - 1;
+            uint64_t i = hash & mask;
+            for (; used[i]; i = (i + 1) & mask) {
+                if (used[i] == tag && Equal{}(keys[i], key)) {
+                    if (inserted) *inserted = false;
+                    return values[i];
+                }
+            }
+
+            used[i] = tag;
+            keys[i] = key;
+            values[i] = value;
+            size++;
+            if (inserted) *inserted = true;
+            return values[i];
+        }
+        void insert(const K& key, const V& value) {
+            findOrInsert(key, value) = value;
+        }
+        // Grows so count entries fit below the load factor, never shrinks
+        void reserve(uint64_t count) {
+            uint64_t new_capacity = 16;
+            while (new_capacity * 3 < count * 4) {
+                new_capacity *= 2;
+            }
+            if (new_capacity <= capacity) {
+                return;
+            }
+
+            K* old_keys = keys;
+            V* old_values = values;
+            uint8_t* old_used = used;
+            uint64_t old_capacity = capacity;
+
+            keys = (K*)alloc(*allocator, new_capacity * sizeof(K), alignof(K));
+            values = (V*)alloc(*allocator, new_capacity * sizeof(V), alignof(V));
+            used = (uint8_t*)alloc(*allocator, new_capacity, 1);
+            memset(used, 0, new_capacity);
+            capacity = new_capacity;
+            size = 0;
+
+            for (uint64_t i = 0; i < old_capacity; i++) {
+                if (old_used[i]) {
+                    findOrInsert(old_keys[i], old_values[i]);
+                }
+            }
+
+            // Arenas only free from the top, the old arrays stay until reset
+            if (old_keys != nullptr && arenaOf(*allocator) == nullptr) {
+                dealloc(*allocator, old_capacity * sizeof(K), old_keys);
+                dealloc(*allocator, old_capacity * sizeof(V), old_values);
+                dealloc(*allocator, old_capacity, old_used);
+            }
+        }
+        void clear() {
+            memset(used, 0, capacity);
+            size = 0;
+        }
+
+    private:
+        // Top bits of the hash, the low bits already picked the slot
+        static uint8_t tagOf(uint64_t hash) {
+            return (uint8_t)(0x80 | (hash >> 57));
+        }
 };
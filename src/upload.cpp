@@ -0,0 +1,286 @@
+#include "upload.h"
+
+// keeps every staging copy source aligned for any texel or index type
+#define STAGING_ALIGNMENT 16
+
+void createUploader(Uploader& result, DeviceAllocator& allocator, VkQueue queue, uint32_t familyIndex,
+    uint32_t dstFamilyIndex, size_t stagingSize){
+    assert(stagingSize % STAGING_ALIGNMENT == 0);
+
+    result = {};
+    result.device = allocator.device;
+    result.queue = queue;
+    result.familyIndex = familyIndex;
+    result.dstFamilyIndex = dstFamilyIndex;
+
+    VkSemaphoreTypeCreateInfo typeInfo{};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &typeInfo;
+    VK_CHECK(vkCreateSemaphore(result.device, &semaphoreInfo, 0, &result.timeline));
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = familyIndex;
+    VK_CHECK(vkCreateCommandPool(result.device, &poolInfo, 0, &result.commandPool));
+
+    for(uint32_t i=0;i<UPLOAD_BATCH_COUNT;i++){
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = result.commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 1;
+        VK_CHECK(vkAllocateCommandBuffers(result.device, &allocInfo, &result.batches[i].commandBuffer));
+    }
+
+    // written by the CPU once and read by the GPU once, coherent memory
+    // saves flushing every staged range
+    createBuffer(result.staging, allocator, stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    assert(result.staging.data);
+}
+
+static void waitTimeline(Uploader& uploader, uint64_t value){
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &uploader.timeline;
+    waitInfo.pValues = &value;
+    VK_CHECK(vkWaitSemaphores(uploader.device, &waitInfo, UINT64_MAX));
+}
+
+// Waits for the oldest submitted batch and releases its ring space, returns
+// false when nothing is in flight
+static bool waitOldestBatch(Uploader& uploader, bool block){
+    uint64_t completed = 0;
+    if(!block)
+        VK_CHECK(vkGetSemaphoreCounterValue(uploader.device, uploader.timeline, &completed));
+
+    // batches are submitted round robin so the oldest is the first pending
+    // one starting at the next to submit
+    for(uint32_t i=0;i<UPLOAD_BATCH_COUNT;i++){
+        UploadBatch& batch = uploader.batches[(uploader.batchIndex + i) % UPLOAD_BATCH_COUNT];
+        if(!batch.pending) continue;
+
+        if(block){
+            waitTimeline(uploader, batch.value);
+        }else if(completed < batch.value){
+            return false;
+        }
+
+        batch.pending = false;
+        uploader.ringTail = batch.ringEnd;
+        return true;
+    }
+
+    return false;
+}
+
+// Returns the ring offset of size free bytes, waiting on older batches when the
+// ring is full
+static uint64_t ringAlloc(Uploader& uploader, uint64_t size){
+    uint64_t ringSize = uploader.staging.size;
+    assert(size <= ringSize);
+
+    uint64_t offset = alignPow2(uploader.ringHead, STAGING_ALIGNMENT);
+
+    // a copy source never wraps around the end of the ring
+    if(offset % ringSize + size > ringSize)
+        offset += ringSize - offset % ringSize;
+
+    while(offset + size - uploader.ringTail > ringSize){
+        if(waitOldestBatch(uploader, true)) continue;
+
+        // the space is held by copies that were never submitted
+        assert(uploader.copyCount > 0);
+        flushUploads(uploader);
+    }
+
+    uploader.ringHead = offset + size;
+    return offset % ringSize;
+}
+
+void uploadBuffer(Uploader& uploader, const Buffer& dst, VkDeviceSize dstOffset, const void* data, size_t size){
+    assert(dstOffset + size <= dst.size);
+
+    // release whatever finished since the last upload without blocking
+    while(waitOldestBatch(uploader, false));
+
+    // larger uploads go through in pieces so the ring can be refilled while
+    // earlier pieces are still copying
+    uint64_t chunk = uploader.staging.size / 2;
+
+    for(size_t copied = 0; copied < size; copied += chunk){
+        uint64_t bytes = size - copied < chunk ? size - copied : chunk;
+
+        if(uploader.copyCount == UPLOAD_MAX_COPIES)
+            flushUploads(uploader);
+
+        uint64_t offset = ringAlloc(uploader, bytes);
+        memcpy((uint8_t*)uploader.staging.data + offset, (const uint8_t*)data + copied, bytes);
+
+        uploader.copyTargets[uploader.copyCount] = dst.buffer;
+        uploader.copyRegions[uploader.copyCount] = {offset, dstOffset + copied, bytes};
+        uploader.copyCount++;
+    }
+
+    uploader.bytesUploaded += size;
+}
+
+uint64_t flushUploads(Uploader& uploader){
+    if(uploader.copyCount == 0) return uploader.timelineValue;
+
+    // only reused once the ring went around all other batches
+    UploadBatch& batch = uploader.batches[uploader.batchIndex];
+    if(batch.pending){
+        waitTimeline(uploader, batch.value);
+        batch.pending = false;
+        uploader.ringTail = batch.ringEnd;
+    }
+
+    uint64_t value = uploader.timelineValue + 1;
+
+    VK_CHECK(vkResetCommandBuffer(batch.commandBuffer, 0));
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK(vkBeginCommandBuffer(batch.commandBuffer, &beginInfo));
+
+    // consecutive copies into the same buffer become one command
+    uint32_t first = 0;
+    for(uint32_t i=1;i<=uploader.copyCount;i++){
+        if(i < uploader.copyCount && uploader.copyTargets[i] == uploader.copyTargets[first]) continue;
+
+        vkCmdCopyBuffer(batch.commandBuffer, uploader.staging.buffer, uploader.copyTargets[first],
+            i - first, &uploader.copyRegions[first]);
+        first = i;
+    }
+
+    // across families the timeline signal makes the copies available and the
+    // graphics submission's wait on it makes them visible
+    if(uploader.familyIndex == uploader.dstFamilyIndex){
+        // make the copies visible to every later submission on this queue
+        VkMemoryBarrier2 barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+        barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+        barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+        barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+        barrier.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT;
+
+        VkDependencyInfo depInfo{};
+        depInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        depInfo.memoryBarrierCount = 1;
+        depInfo.pMemoryBarriers = &barrier;
+        vkCmdPipelineBarrier2(batch.commandBuffer, &depInfo);
+    }
+
+    VK_CHECK(vkEndCommandBuffer(batch.commandBuffer));
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &value;
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &batch.commandBuffer;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &uploader.timeline;
+    VK_CHECK(vkQueueSubmit(uploader.queue, 1, &submitInfo, VK_NULL_HANDLE));
+
+    uploader.timelineValue = value;
+    batch.value = value;
+    batch.ringEnd = uploader.ringHead;
+    batch.pending = true;
+    uploader.batchIndex = (uploader.batchIndex + 1) % UPLOAD_BATCH_COUNT;
+    uploader.copyCount = 0;
+
+    return value;
+}
+
+uint64_t acquireUploads(Uploader& uploader){
+    uint64_t completed = 0;
+    VK_CHECK(vkGetSemaphoreCounterValue(uploader.device, uploader.timeline, &completed));
+    uploader.acquiredValue = completed;
+
+    // the barrier at the end of each batch already covers later submissions
+    if(uploader.familyIndex == uploader.dstFamilyIndex) return 0;
+
+    // already reached, the wait only makes the copies visible
+    return completed;
+}
+
+void waitUploads(Uploader& uploader){
+    flushUploads(uploader);
+    while(waitOldestBatch(uploader, true));
+}
+
+void destroyUploader(Uploader& uploader, DeviceAllocator& allocator){
+    waitUploads(uploader);
+
+    vkDestroySemaphore(uploader.device, uploader.timeline, 0);
+
+    // frees the batch command buffers with it
+    vkDestroyCommandPool(uploader.device, uploader.commandPool, 0);
+    destroyBuffer(uploader.staging, allocator);
+}
+
+void createFrameUniforms(FrameUniforms& result, DeviceAllocator& allocator, uint32_t frameCount, size_t sliceSize){
+    result = {};
+    result.uniformAlignment = allocator.minUniformAlignment;
+    result.storageAlignment = allocator.minStorageAlignment;
+
+    // every slice starts aligned for both kinds of bindings
+    VkDeviceSize alignment = result.uniformAlignment > result.storageAlignment ? result.uniformAlignment : result.storageAlignment;
+    result.sliceSize = alignPow2(sliceSize, alignment);
+
+    // the GPU reads each byte about once so it is not worth a copy into
+    // device local memory
+    createBuffer(result.buffer, allocator, result.sliceSize * frameCount,
+        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    assert(result.buffer.data);
+}
+
+void destroyFrameUniforms(FrameUniforms& uniforms, DeviceAllocator& allocator){
+    destroyBuffer(uniforms.buffer, allocator);
+}
+
+void frameUniformsBegin(FrameUniforms& uniforms, uint32_t frame){
+    assert((frame + 1) * uniforms.sliceSize <= uniforms.buffer.size);
+    uniforms.sliceBegin = frame * uniforms.sliceSize;
+    uniforms.offset = 0;
+}
+
+static UniformAllocation frameAlloc(FrameUniforms& uniforms, size_t size, VkDeviceSize alignment){
+    VkDeviceSize offset = alignPow2(uniforms.offset, alignment);
+
+    if(offset + size > uniforms.sliceSize){
+        printf("Error, frame uniforms of %llu bytes overflowed\n", (unsigned long long)uniforms.sliceSize);
+        exit(-1);
+    }
+
+    uniforms.offset = offset + size;
+
+    UniformAllocation result;
+    result.data = (uint8_t*)uniforms.buffer.data + uniforms.sliceBegin + offset;
+    result.buffer = uniforms.buffer.buffer;
+    result.offset = uniforms.sliceBegin + offset;
+    return result;
+}
+
+UniformAllocation frameUniformAlloc(FrameUniforms& uniforms, size_t size){
+    return frameAlloc(uniforms, size, uniforms.uniformAlignment);
+}
+
+UniformAllocation frameStorageAlloc(FrameUniforms& uniforms, size_t size){
+    return frameAlloc(uniforms, size, uniforms.storageAlignment);
+}
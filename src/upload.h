@@ -0,0 +1,108 @@
+#pragma once
+#include "common.h"
+#include "memory.h"
+
+// Bytes of host visible staging memory shared by all uploads in flight
+#define STAGING_RING_SIZE (64ull << 20)
+// Submitted batches the ring can wait on before reusing their staging space
+#define UPLOAD_BATCH_COUNT 4
+// Copies recorded per batch, the batch is flushed early when full
+#define UPLOAD_MAX_COPIES 256
+
+// One submission of staging copies, once the timeline reaches value the ring
+// space it used up to ringEnd can be written again
+struct UploadBatch{
+    VkCommandBuffer commandBuffer;
+    uint64_t value;
+    uint64_t ringEnd;
+    bool pending;
+};
+
+// Streams data into device local buffers through a persistently mapped ring,
+// ringHead and ringTail only grow and are wrapped by the ring size on use.
+// With a dedicated transfer queue the copies run next to rendering, the
+// destination buffers are created concurrent for both families (see
+// createDeviceAllocator) so one buffer can take copies from any number of batches
+struct Uploader{
+    VkDevice device;
+    VkQueue queue;
+    uint32_t familyIndex;
+    uint32_t dstFamilyIndex; // family that uses the uploaded buffers
+    VkCommandPool commandPool;
+
+    // signalled with each batch value, the graphics queue waits on it
+    VkSemaphore timeline;
+    uint64_t timelineValue; // last submitted
+    uint64_t acquiredValue; // batches up to here are usable on the graphics queue
+
+    Buffer staging;
+    uint64_t ringHead; // bytes written
+    uint64_t ringTail; // bytes whose copies have completed
+
+    UploadBatch batches[UPLOAD_BATCH_COUNT];
+    uint32_t batchIndex; // next batch to submit
+
+    // copies waiting for the next flush, regions of one flush must not overlap
+    VkBuffer copyTargets[UPLOAD_MAX_COPIES];
+    VkBufferCopy copyRegions[UPLOAD_MAX_COPIES];
+    uint32_t copyCount;
+
+    uint64_t bytesUploaded;
+};
+
+void createUploader(Uploader& result, DeviceAllocator& allocator, VkQueue queue, uint32_t familyIndex,
+    uint32_t dstFamilyIndex, size_t stagingSize = STAGING_RING_SIZE);
+
+void destroyUploader(Uploader& uploader, DeviceAllocator& allocator);
+
+// Copies size bytes of data into the staging ring and queues a copy to
+// dst at dstOffset, data may be reused as soon as this returns
+void uploadBuffer(Uploader& uploader, const Buffer& dst, VkDeviceSize dstOffset, const void* data, size_t size);
+
+// Submits the queued copies and returns the timeline value they signal,
+// the data is usable once acquiredValue reached it
+uint64_t flushUploads(Uploader& uploader);
+
+// Makes every completed batch usable on the graphics queue, never waits for
+// uploads still running. Returns the timeline value the next graphics
+// submission has to wait on for their writes to be visible, 0 when none
+uint64_t acquireUploads(Uploader& uploader);
+
+// Flushes and blocks until every upload completed
+void waitUploads(Uploader& uploader);
+
+// Bytes of per frame constants each frame in flight can write
+#define FRAME_UNIFORM_SIZE (4ull << 20)
+
+// Where a block of frame constants was placed, data is written by the CPU and
+// buffer/offset go into descriptors or push constants
+struct UniformAllocation{
+    void* data;
+    VkBuffer buffer;
+    VkDeviceSize offset;
+};
+
+// One persistently mapped buffer split into a slice per frame in flight, each
+// slice is a linear allocator that starts over once its frame fence signalled
+struct FrameUniforms{
+    Buffer buffer;
+    VkDeviceSize sliceSize;
+    VkDeviceSize sliceBegin; // current frame's slice
+    VkDeviceSize offset; // bytes used in the current slice
+    VkDeviceSize uniformAlignment;
+    VkDeviceSize storageAlignment;
+};
+
+void createFrameUniforms(FrameUniforms& result, DeviceAllocator& allocator, uint32_t frameCount,
+    size_t sliceSize = FRAME_UNIFORM_SIZE);
+
+void destroyFrameUniforms(FrameUniforms& uniforms, DeviceAllocator& allocator);
+
+// Switches to frame's slice, only after that frame's fence signalled
+void frameUniformsBegin(FrameUniforms& uniforms, uint32_t frame);
+
+// Aligned for uniform buffer bindings
+UniformAllocation frameUniformAlloc(FrameUniforms& uniforms, size_t size);
+
+// Aligned for storage buffer bindings, for instance data
+UniformAllocation frameStorageAlloc(FrameUniforms& uniforms, size_t size);